@@ -0,0 +1,66 @@
+//
+//  activation.cpp
+//  NeuroEvolution
+//
+
+#include "activation.h"
+
+template <uint8 function, class T>
+static void ne_kernel(T* x, uint64 n) {
+    typedef typename ne_simd<T>::vector V;
+    typedef typename ne_simd<T>::scalar S;
+    
+    uint64 i = 0;
+    
+    for(; i + V::width <= n; i += V::width) {
+        V::store(x + i, ne_activate<V>(function, V::load(x + i)));
+    }
+    
+    for(; i != n; ++i) {
+        x[i] = ne_activate<S>(function, x[i]);
+    }
+}
+
+template <class T>
+static void ne_dispatch(uint8 function, T* x, uint64 n) {
+    switch(function) {
+        case ne_softsign:
+            ne_kernel<ne_softsign>(x, n);
+            break;
+        
+        case ne_relu:
+            ne_kernel<ne_relu>(x, n);
+            break;
+        
+        case ne_identity:
+            break;
+
+#ifdef NE_FAST_ACTIVATIONS
+        case ne_tanh:
+            ne_kernel<ne_tanh>(x, n);
+            break;
+        
+        case ne_sigmoid:
+            ne_kernel<ne_sigmoid>(x, n);
+            break;
+        
+        case ne_gaussian:
+            ne_kernel<ne_gaussian>(x, n);
+            break;
+#endif
+
+        default:
+            for(uint64 i = 0; i != n; ++i) {
+                x[i] = ne_activate(function, x[i]);
+            }
+            break;
+    }
+}
+
+void ne_activate(uint8 function, float64* x, uint64 n) {
+    ne_dispatch(function, x, n);
+}
+
+void ne_activate(uint8 function, float32* x, uint64 n) {
+    ne_dispatch(function, x, n);
+}
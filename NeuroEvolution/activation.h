@@ -0,0 +1,94 @@
+//
+//  activation.h
+//  NeuroEvolution
+//
+
+#ifndef ne_activation_h
+#define ne_activation_h
+
+#include "simd.h"
+
+enum ne_activation
+{
+    ne_softsign = 0,
+    ne_tanh,
+    ne_sigmoid,
+    ne_relu,
+    ne_gaussian,
+    ne_identity,
+    ne_activation_count
+};
+
+/// With NE_FAST_ACTIVATIONS defined, tanh, sigmoid and gaussian go through
+/// ne_exp everywhere, including ne_genome::compute, so the vector kernels
+/// stay bitwise equal to the scalar path. The absolute error against libm
+/// is then below 1e-15 for all three. Without it they call libm and only
+/// the other functions are vectorized.
+template <class S>
+inline typename S::type ne_activate(uint8 function, typename S::type x) {
+    switch(function) {
+        case ne_softsign:
+            return S::add(S::set1(1.0), S::div(x, S::add(S::set1(1.0), S::abs(x))));
+        
+        case ne_tanh: {
+            typename S::type e = ne_exp<S>(S::mul(S::set1(-2.0), S::abs(x)));
+            return S::copysign(S::div(S::sub(S::set1(1.0), e), S::add(S::set1(1.0), e)), x);
+        }
+        
+        case ne_sigmoid:
+            return S::div(S::set1(1.0), S::add(S::set1(1.0), ne_exp<S>(S::sub(S::set1(0.0), x))));
+        
+        case ne_relu:
+            return S::max(x, S::set1(0.0));
+        
+        case ne_gaussian:
+            return ne_exp<S>(S::sub(S::set1(0.0), S::mul(x, x)));
+        
+        default:
+            return x;
+    }
+}
+
+inline float64 ne_activate(uint8 function, float64 x) {
+#ifndef NE_FAST_ACTIVATIONS
+    switch(function) {
+        case ne_tanh:
+            return tanh(x);
+        
+        case ne_sigmoid:
+            return 1.0 / (1.0 + exp(-x));
+        
+        case ne_gaussian:
+            return exp(-x * x);
+        
+        default:
+            break;
+    }
+#endif
+
+    return ne_activate<ne_scalar>(function, x);
+}
+
+/// Without NE_FAST_ACTIVATIONS the libm functions are taken in double
+/// precision and rounded once.
+inline float32 ne_activate(uint8 function, float32 x) {
+#ifndef NE_FAST_ACTIVATIONS
+    switch(function) {
+        case ne_tanh:
+        case ne_sigmoid:
+        case ne_gaussian:
+            return (float32) ne_activate(function, (float64) x);
+        
+        default:
+            break;
+    }
+#endif
+
+    return ne_activate<ne_scalar32>(function, x);
+}
+
+void ne_activate(uint8 function, float64* x, uint64 n);
+
+void ne_activate(uint8 function, float32* x, uint64 n);
+
+#endif /* ne_activation_h */
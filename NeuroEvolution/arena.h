@@ -0,0 +1,98 @@
+//
+//  arena.h
+//  NeuroEvolution
+//
+
+#ifndef ne_arena_h
+#define ne_arena_h
+
+#include "common.h"
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/// A bump allocator for trivially destructible objects. Objects are never
+/// freed one by one; clear() releases all of them at once and keeps the
+/// memory, merged into a single block, for the next fill.
+template <class T>
+class ne_arena
+{
+    
+    static_assert(std::is_trivially_destructible<T>::value, "ne_arena only holds trivially destructible types");
+    
+public:
+    
+    ne_arena() {}
+    
+    ne_arena(const ne_arena& arena) = delete;
+    
+    ne_arena& operator = (const ne_arena& arena) = delete;
+    
+    ~ne_arena() {
+        _free();
+    }
+    
+    inline T* create(const T& x) {
+        if(used == capacity)
+            _grow(capacity * 2);
+        
+        return new (data + used++) T(x);
+    }
+    
+    void reserve(uint64 n) {
+        if(capacity - used < n)
+            _grow(n);
+    }
+    
+    void clear() {
+        if(blocks.size() > 1) {
+            uint64 total = 0;
+            
+            for(const ne_block& block : blocks)
+                total += block.capacity;
+            
+            _free();
+            _grow(total);
+        }
+        
+        used = 0;
+    }
+    
+private:
+    
+    struct ne_block
+    {
+        T* data;
+        uint64 capacity;
+    };
+    
+    void _grow(uint64 n) {
+        n = n < 64 ? 64 : n;
+        
+        data = static_cast<T*>(::operator new(n * sizeof(T)));
+        capacity = n;
+        used = 0;
+        
+        blocks.push_back({ data, n });
+    }
+    
+    void _free() {
+        for(const ne_block& block : blocks)
+            ::operator delete(block.data);
+        
+        blocks.clear();
+        
+        data = nullptr;
+        capacity = 0;
+        used = 0;
+    }
+    
+    std::vector<ne_block> blocks;
+    
+    T* data = nullptr;
+    
+    uint64 capacity = 0;
+    uint64 used = 0;
+};
+
+#endif /* ne_arena_h */
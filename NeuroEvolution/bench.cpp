@@ -0,0 +1,447 @@
+//
+//  bench.cpp
+//  NeuroEvolution
+//
+
+#include "population.h"
+#include "group.h"
+#include "quantize.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+/// Microbenchmarks for the hot paths, parameterized by genome size and
+/// activations. Usage: bench <params file> [--csv] [filter]
+///
+/// Every case is timed in batches that grow until one batch takes at least
+/// ne_min_time; the fastest of ne_samples batches is reported per op.
+
+static const float64 ne_min_time = 0.02;
+static const uint64 ne_samples = 5;
+
+static const uint64 ne_inputs = 4;
+static const uint64 ne_outputs = 2;
+
+/// Genomes per group in group/compute, which differ only in weights.
+static const uint64 ne_group_lanes = 64;
+
+typedef std::chrono::steady_clock ne_clock;
+
+struct ne_result
+{
+    std::string name;
+    
+    float64 genes;
+    float64 nodes;
+    
+    uint64 activations;
+    uint64 population;
+    uint64 iterations;
+    
+    float64 ns;
+};
+
+ne_params params;
+
+std::vector<ne_result> results;
+
+std::string filter;
+
+static float64 seconds(ne_clock::time_point a, ne_clock::time_point b) {
+    return std::chrono::duration<float64>(b - a).count();
+}
+
+/// Times run(k) for k in [0, n) after an untimed prepare(n).
+static float64 measure(const std::function<void (uint64 n)>& prepare, const std::function<void (uint64 k)>& run, uint64* iterations) {
+    uint64 n = 1;
+    float64 best = DBL_MAX;
+    
+    for(uint64 s = 0; s != ne_samples;) {
+        prepare(n);
+        
+        ne_clock::time_point begin = ne_clock::now();
+        
+        for(uint64 k = 0; k != n; ++k) {
+            run(k);
+        }
+        
+        float64 t = seconds(begin, ne_clock::now());
+        
+        if(t < ne_min_time && n < ((uint64) 1 << 30)) {
+            n *= 2;
+            continue;
+        }
+        
+        best = std::min(best, t / n);
+        *iterations = n;
+        ++s;
+    }
+    
+    return best * 1e9;
+}
+
+/// Times run() alone, calling the untimed setup() before each call. For
+/// operations that are expensive and change the state they run on.
+static float64 measure_each(const std::function<void ()>& setup, const std::function<void ()>& run, uint64* iterations) {
+    float64 total = 0.0;
+    uint64 n = 0;
+    
+    while(total < ne_min_time * ne_samples || n < ne_samples) {
+        setup();
+        
+        ne_clock::time_point begin = ne_clock::now();
+        run();
+        total += seconds(begin, ne_clock::now());
+        
+        ++n;
+    }
+    
+    *iterations = n;
+    return total / n * 1e9;
+}
+
+static bool enabled(const std::string& name) {
+    return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+static void report(const std::string& name, float64 genes, float64 nodes, uint64 activations, uint64 population, uint64 iterations, float64 ns) {
+    results.push_back({ name, genes, nodes, activations, population, iterations, ns });
+    std::cerr << name << "  genes " << genes << "  activations " << activations << "  " << ns << " ns" << std::endl;
+}
+
+/// Grows a minimal genome by adding nodes and genes until it has `genes`
+/// genes, or gives up once the mutations stop finding room.
+static void grow(ne_genome* genome, uint64 genes, ne_innovation_set* set, uint64* innovation, uint64* node_ids) {
+    for(uint64 n = 0; genome->gene_count() < genes && n != genes * 8; ++n) {
+        if(random(0.0, 1.0) < 0.25)
+            genome->mutate_add_node(set, innovation, node_ids, params);
+        else
+            genome->mutate_add_gene(set, innovation, params);
+    }
+    
+    genome->mutate_weights(params);
+}
+
+static void bench_genome(uint64 genes) {
+    ne_innovation_set set;
+    uint64 innovation = 0;
+    uint64 node_ids = ne_inputs + 1 + ne_outputs;
+    
+    ne_genome A, B;
+    
+    A.reset(ne_inputs, ne_outputs, &set, &innovation);
+    B.reset(ne_inputs, ne_outputs, &set, &innovation);
+    
+    grow(&A, genes, &set, &innovation, &node_ids);
+    
+    B = A;
+    grow(&B, genes + genes / 4, &set, &innovation, &node_ids);
+    
+    A.fitness = 1.0;
+    B.fitness = 0.0;
+    
+    float64 g = A.gene_count(), v = A.node_count();
+    uint64 iterations;
+    float64 ns;
+    
+    std::vector<ne_genome> copies;
+    std::vector<ne_genome*> news;
+    
+    auto fill = [&copies, &A](uint64 n) {
+        copies.resize(n);
+        
+        for(ne_genome& c : copies) {
+            c = A;
+        }
+    };
+    
+    for(uint64 activations : { 1, 4 }) {
+        A.activations = activations;
+        
+        if(enabled("genome/compute")) {
+            A.flush();
+            ns = measure([](uint64) {}, [&A](uint64) { A.compute(); }, &iterations);
+            report("genome/compute", g, v, activations, 0, iterations, ns);
+        }
+        
+        if(enabled("phenotype/compute")) {
+            ne_phenotype64 net(&A);
+            net.flush();
+            ns = measure([](uint64) {}, [&net](uint64) { net.compute(); }, &iterations);
+            report("phenotype/compute", g, v, activations, 0, iterations, ns);
+        }
+        
+        if(enabled("phenotype/batch")) {
+            ne_phenotype64 net(&A);
+            std::vector<float64> x(ne_batch_block * ne_inputs, 0.5), y(ne_batch_block * ne_outputs);
+            ns = measure([](uint64) {}, [&](uint64) { net.compute(x.data(), y.data(), ne_batch_block); }, &iterations);
+            report("phenotype/batch", g, v, activations, 0, iterations, ns / ne_batch_block);
+        }
+        
+        if(enabled("phenotype32/compute")) {
+            ne_phenotype32 net(&A);
+            net.flush();
+            ns = measure([](uint64) {}, [&net](uint64) { net.compute(); }, &iterations);
+            report("phenotype32/compute", g, v, activations, 0, iterations, ns);
+        }
+        
+        if(enabled("phenotype32/batch")) {
+            ne_phenotype32 net(&A);
+            std::vector<float32> x(ne_batch_block * ne_inputs, 0.5f), y(ne_batch_block * ne_outputs);
+            ns = measure([](uint64) {}, [&](uint64) { net.compute(x.data(), y.data(), ne_batch_block); }, &iterations);
+            report("phenotype32/batch", g, v, activations, 0, iterations, ns / ne_batch_block);
+        }
+        
+        if(enabled("quantized8/compute") || enabled("quantized16/compute")) {
+            std::vector<float64> samples(ne_batch_block * ne_inputs);
+            
+            for(uint64 k = 0; k != samples.size(); ++k) {
+                samples[k] = sin(k * 0.37);
+            }
+            
+            if(enabled("quantized8/compute")) {
+                ne_quantized8 net(&A, samples.data(), ne_batch_block);
+                net.flush();
+                ns = measure([](uint64) {}, [&net](uint64) { net.compute(); }, &iterations);
+                report("quantized8/compute", g, v, activations, 0, iterations, ns);
+            }
+            
+            if(enabled("quantized16/compute")) {
+                ne_quantized16 net(&A, samples.data(), ne_batch_block);
+                net.flush();
+                ns = measure([](uint64) {}, [&net](uint64) { net.compute(); }, &iterations);
+                report("quantized16/compute", g, v, activations, 0, iterations, ns);
+            }
+        }
+        
+        if(enabled("group/compute") || enabled("group32/compute")) {
+            std::vector<ne_genome> lanes(ne_group_lanes, A);
+            std::vector<ne_genome*> members;
+            
+            for(ne_genome& lane : lanes) {
+                lane.mutate_weights(params);
+                members.push_back(&lane);
+            }
+            
+            if(enabled("group/compute")) {
+                ne_group64 net(members.data(), members.size());
+                std::vector<float64> x(ne_group_lanes * ne_inputs, 0.5), y(ne_group_lanes * ne_outputs);
+                
+                net.flush();
+                ns = measure([](uint64) {}, [&](uint64) { net.compute(x.data(), y.data()); }, &iterations);
+                report("group/compute", g, v, activations, 0, iterations, ns / ne_group_lanes);
+            }
+            
+            if(enabled("group32/compute")) {
+                ne_group32 net(members.data(), members.size());
+                std::vector<float32> x(ne_group_lanes * ne_inputs, 0.5f), y(ne_group_lanes * ne_outputs);
+                
+                net.flush();
+                ns = measure([](uint64) {}, [&](uint64) { net.compute(x.data(), y.data()); }, &iterations);
+                report("group32/compute", g, v, activations, 0, iterations, ns / ne_group_lanes);
+            }
+        }
+    }
+    
+    A.activations = 1;
+    
+    if(enabled("genome/flush")) {
+        ns = measure([](uint64) {}, [&A](uint64) { A.flush(); }, &iterations);
+        report("genome/flush", g, v, 1, 0, iterations, ns);
+    }
+    
+    if(enabled("genome/crossover")) {
+        ne_genome C;
+        ns = measure([](uint64) {}, [&](uint64) { ne_genome::crossover(&A, &B, &C, params); }, &iterations);
+        report("genome/crossover", g, v, 1, 0, iterations, ns);
+    }
+    
+    if(enabled("genome/distance")) {
+        volatile float64 sink = 0.0;
+        ns = measure([](uint64) {}, [&](uint64) { sink = sink + ne_genome::distance(&A, &B, params); }, &iterations);
+        report("genome/distance", g, v, 1, 0, iterations, ns);
+    }
+    
+    if(enabled("genome/mutate_add_node")) {
+        ns = measure(fill, [&](uint64 k) { copies[k].mutate_add_node(&set, &innovation, &node_ids, params); }, &iterations);
+        report("genome/mutate_add_node", g, v, 1, 0, iterations, ns);
+    }
+    
+    if(enabled("genome/mutate_add_gene")) {
+        ns = measure(fill, [&](uint64 k) { copies[k].mutate_add_gene(&set, &innovation, params); }, &iterations);
+        report("genome/mutate_add_gene", g, v, 1, 0, iterations, ns);
+    }
+    
+    if(enabled("genome/mutate_weights")) {
+        ns = measure([](uint64) {}, [&A](uint64) { A.mutate_weights(params); }, &iterations);
+        report("genome/mutate_weights", g, v, 1, 0, iterations, ns);
+    }
+    
+    if(enabled("genome/copy")) {
+        auto clear = [&news](uint64 n) {
+            for(ne_genome* c : news) {
+                delete c;
+            }
+            
+            news.assign(n, nullptr);
+        };
+        
+        ns = measure(clear, [&](uint64 k) { news[k] = new ne_genome(A); }, &iterations);
+        report("genome/copy", g, v, 1, 0, iterations, ns);
+        
+        clear(0);
+    }
+    
+    if(enabled("genome/assign")) {
+        ns = measure(fill, [&](uint64 k) { copies[k] = B; }, &iterations);
+        report("genome/assign", g, v, 1, 0, iterations, ns);
+    }
+    
+    if(enabled("phenotype/compile")) {
+        ne_phenotype64 net;
+        ns = measure([](uint64) {}, [&](uint64) { net.compile(&A); }, &iterations);
+        report("phenotype/compile", g, v, 1, 0, iterations, ns);
+    }
+    
+    /// The same mutations with a compiled network kept current, which
+    /// copies made by fill() inherit from here on.
+    A.network();
+    
+    if(enabled("phenotype/mutate_add_node")) {
+        ns = measure(fill, [&](uint64 k) { copies[k].mutate_add_node(&set, &innovation, &node_ids, params); }, &iterations);
+        report("phenotype/mutate_add_node", g, v, 1, 0, iterations, ns);
+    }
+    
+    if(enabled("phenotype/mutate_add_gene")) {
+        ns = measure(fill, [&](uint64 k) { copies[k].mutate_add_gene(&set, &innovation, params); }, &iterations);
+        report("phenotype/mutate_add_gene", g, v, 1, 0, iterations, ns);
+    }
+    
+    if(enabled("phenotype/mutate_weights")) {
+        ns = measure([](uint64) {}, [&A](uint64) { A.mutate_weights(params); }, &iterations);
+        report("phenotype/mutate_weights", g, v, 1, 0, iterations, ns);
+    }
+}
+
+static void bench_population(uint64 genes) {
+    if(!enabled("population/"))
+        return;
+    
+    ne_population population;
+    population.reset(params, ne_inputs, ne_outputs);
+    
+    ne_innovation_set set;
+    
+    for(ne_genome* genome : population.genomes) {
+        grow(genome, genes, &set, &population.innovation, &population.node_ids);
+    }
+    
+    population.speciate();
+    
+    float64 g = 0.0, v = 0.0;
+    
+    for(ne_genome* genome : population.genomes) {
+        g += genome->gene_count();
+        v += genome->node_count();
+    }
+    
+    g /= population.genomes.size();
+    v /= population.genomes.size();
+    
+    uint64 size = population.genomes.size();
+    uint64 iterations;
+    float64 ns;
+    
+    auto score = [&population]() {
+        population.evaluate([](ne_genome*, uint64) {
+            return random(0.0, 1.0);
+        });
+    };
+    
+    if(enabled("population/speciate")) {
+        ns = measure_each([]() {}, [&population]() { population.speciate(); }, &iterations);
+        report("population/speciate", g, v, 1, size, iterations, ns);
+    }
+    
+    if(enabled("population/select")) {
+        ns = measure_each(score, [&population]() { population.select(); }, &iterations);
+        report("population/select", g, v, 1, size, iterations, ns);
+    }
+    
+    if(enabled("population/reproduce")) {
+        auto setup = [&]() {
+            score();
+            population.select();
+        };
+        
+        ns = measure_each(setup, [&population]() { population.reproduce(); }, &iterations);
+        report("population/reproduce", g, v, 1, size, iterations, ns);
+    }
+}
+
+static void print_json() {
+    std::cout << "[" << std::endl;
+    
+    for(uint64 i = 0; i != results.size(); ++i) {
+        const ne_result& r = results[i];
+        
+        std::cout << "  {\"name\": \"" << r.name << "\", \"genes\": " << r.genes << ", \"nodes\": " << r.nodes;
+        std::cout << ", \"activations\": " << r.activations << ", \"population\": " << r.population;
+        std::cout << ", \"iterations\": " << r.iterations << ", \"ns_per_op\": " << r.ns << "}";
+        std::cout << (i + 1 != results.size() ? "," : "") << std::endl;
+    }
+    
+    std::cout << "]" << std::endl;
+}
+
+static void print_csv() {
+    std::cout << "name,genes,nodes,activations,population,iterations,ns_per_op" << std::endl;
+    
+    for(const ne_result& r : results) {
+        std::cout << r.name << "," << r.genes << "," << r.nodes << "," << r.activations << "," << r.population << "," << r.iterations << "," << r.ns << std::endl;
+    }
+}
+
+int main(int argc, const char * argv[]) {
+    if(argc == 1) {
+        std::cout << "Usage: bench <params file> [--csv] [filter]" << std::endl;
+        return 1;
+    }
+    
+    std::ifstream in(argv[1]);
+    
+    if(!params.load(in)) {
+        std::cout << "Cannot read " << argv[1] << std::endl;
+        return 1;
+    }
+    
+    bool csv = false;
+    
+    for(int i = 2; i < argc; ++i) {
+        if(strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else
+            filter = argv[i];
+    }
+    
+    if(params.seed == 0)
+        params.seed = 1;
+    
+    ne_seed(params.seed);
+    
+    for(uint64 genes : { 16, 64, 256, 1024 }) {
+        bench_genome(genes);
+    }
+    
+    for(uint64 genes : { 16, 64, 256 }) {
+        bench_population(genes);
+    }
+    
+    if(csv)
+        print_csv();
+    else
+        print_json();
+    
+    return 0;
+}
@@ -0,0 +1,324 @@
+//
+//  codegen.cpp
+//  NeuroEvolution
+//
+
+#include "codegen.h"
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <iomanip>
+
+/// 17 significant digits give back the same double.
+static std::string ne_literal(float64 x) {
+    std::ostringstream out;
+    out << std::setprecision(17) << x;
+    return out.str();
+}
+
+ne_codegen::ne_codegen(const ne_genome* genome, bool feed_forward) : ok(false), kept(0), bias(ne_codegen_none) {
+    ne_phenotype64 net(genome, feed_forward);
+    
+    uint64 size = net.values.size();
+    
+    forward = net.forward;
+    
+    for(uint64 j = 0; j != size; ++j) {
+        for(uint64 e = net.ranges[j].begin; e != net.ranges[j].end; ++e) {
+            if(!std::isfinite(net.weights[e]))
+                return;
+        }
+    }
+    
+    /// Everything an output depends on, through any number of steps.
+    std::vector<uint8> needed(size, 0);
+    std::vector<uint32> stack;
+    
+    for(uint64 i = 0; i != net.output_size; ++i) {
+        needed[net.input_size + i] = 1;
+        stack.push_back((uint32) (net.input_size + i));
+    }
+    
+    while(!stack.empty()) {
+        uint32 u = stack.back();
+        stack.pop_back();
+        
+        for(uint64 e = net.ranges[u].begin; e != net.ranges[u].end; ++e) {
+            if(!needed[net.sources[e]]) {
+                needed[net.sources[e]] = 1;
+                stack.push_back(net.sources[e]);
+            }
+        }
+    }
+    
+    std::vector<uint32> ids(size, ne_codegen_none);
+    
+    for(uint64 j = 0; j != size; ++j) {
+        if(needed[j])
+            ids[j] = (uint32) kept++;
+    }
+    
+    inputs.assign(ids.begin(), ids.begin() + net.input_count());
+    outputs.assign(ids.begin() + net.input_size, ids.begin() + net.input_size + net.output_size);
+    bias = ids[net.bias_node];
+    
+    auto step = [&](uint64 j, const std::vector<uint8>& active, uint8* c) {
+        ne_step s = { ids[j], j >= net.hidden_begin ? net.functions[j] : (uint8) ne_identity, {} };
+        
+        *c = 0;
+        
+        for(uint64 e = net.ranges[j].begin; e != net.ranges[j].end; ++e) {
+            if(active[net.sources[e]]) {
+                *c = 1;
+                s.terms.push_back({ ids[net.sources[e]], net.weights[e] });
+            }
+        }
+        
+        return s;
+    };
+    
+    std::vector<uint8> active(size), next(size);
+    std::map<std::vector<uint8>, uint64> seen;
+    
+    for(uint64 i = 0; i != size; ++i) {
+        active[i] = i < net.input_size;
+    }
+    
+    while(true) {
+        std::map<std::vector<uint8>, uint64>::const_iterator found = seen.find(active);
+        
+        if(found != seen.end()) {
+            phases.back().next = found->second;
+            break;
+        }
+        
+        if(phases.size() == ne_codegen_phases) {
+            phases.clear();
+            return;
+        }
+        
+        seen[active] = phases.size();
+        
+        if(!phases.empty())
+            phases.back().next = phases.size();
+        
+        phases.push_back(ne_phase());
+        
+        ne_phase& phase = phases.back();
+        
+        if(forward) {
+            phase.sweeps.resize(1);
+            
+            for(uint32 j : net.order) {
+                if(net.ranges[j].begin == net.ranges[j].end) continue;
+                
+                uint8 c;
+                ne_step s = step(j, active, &c);
+                
+                if(c && needed[j])
+                    phase.sweeps[0].push_back(s);
+                
+                active[j] = c;
+            }
+            
+            continue;
+        }
+        
+        for(uint64 n = 0; n != net.activations; ++n) {
+            ne_sweep sweep;
+            
+            for(uint64 j = 0; j != size; ++j) {
+                ne_step s = step(j, active, &next[j]);
+                
+                if(next[j] && needed[j])
+                    sweep.push_back(s);
+            }
+            
+            active.swap(next);
+            phase.sweeps.push_back(sweep);
+        }
+    }
+    
+    ok = true;
+}
+
+void ne_codegen::write(std::ostream& out, const std::string& name) const {
+    if(!ok)
+        return;
+    
+    static const char* const names[] = { "softsign", "tanh", "sigmoid", "relu", "gaussian", "identity" };
+    
+    bool used[ne_activation_count] = {};
+    
+    for(const ne_phase& phase : phases) {
+        for(const ne_sweep& sweep : phase.sweeps) {
+            for(const ne_step& s : sweep) {
+                used[s.function] = true;
+            }
+        }
+    }
+    
+    out << "// " << name << ": a network generated by ne_codegen, " << kept << " nodes in " << phases.size() << " phases." << std::endl;
+    out << "// It matches its genome bit for bit only if no multiply-add is fused, as with" << std::endl;
+    out << "// -ffp-contract=off; the pragmas below ask for that in this file." << std::endl;
+    out << std::endl;
+    out << "#include <cmath>" << std::endl;
+    out << std::endl;
+    out << "#if defined(__clang__)" << std::endl;
+    out << "#pragma clang fp contract(off)" << std::endl;
+    out << "#elif defined(__GNUC__)" << std::endl;
+    out << "#pragma GCC optimize(\"fp-contract=off\")" << std::endl;
+    out << "#else" << std::endl;
+    out << "#pragma STDC FP_CONTRACT OFF" << std::endl;
+    out << "#endif" << std::endl;
+    out << std::endl;
+    out << "struct " << name << "_state" << std::endl;
+    out << "{" << std::endl;
+    out << "    double values[" << kept << "];" << std::endl;
+    out << "    unsigned phase;" << std::endl;
+    out << "};" << std::endl;
+    out << std::endl;
+
+#ifdef NE_FAST_ACTIVATIONS
+    if(used[ne_tanh] || used[ne_sigmoid] || used[ne_gaussian]) {
+        out << "inline double " << name << "_exp(double x) {" << std::endl;
+        out << "    x = x > -708.0 ? x : -708.0;" << std::endl;
+        out << "    x = x < 709.0 ? x : 709.0;" << std::endl;
+        out << "    double k = (x * 1.4426950408889634 + 6755399441055744.0) - 6755399441055744.0;" << std::endl;
+        out << "    double r = (x - k * 6.93145751953125e-1) - k * 1.42860682030941723212e-6;" << std::endl;
+        out << "    double p = 1.0 / 479001600.0;" << std::endl;
+        
+        const char* const terms[] = { "1.0 / 39916800.0", "1.0 / 3628800.0", "1.0 / 362880.0", "1.0 / 40320.0", "1.0 / 5040.0", "1.0 / 720.0", "1.0 / 120.0", "1.0 / 24.0", "1.0 / 6.0", "0.5", "1.0", "1.0" };
+        
+        for(const char* term : terms) {
+            out << "    p = p * r + " << term << ";" << std::endl;
+        }
+        
+        out << "    return p * std::ldexp(1.0, (int) k);" << std::endl;
+        out << "}" << std::endl;
+        out << std::endl;
+    }
+#endif
+
+#ifdef NE_FAST_ACTIVATIONS
+    const std::string bodies[] = {
+        "1.0 + x / (1.0 + std::fabs(x))",
+        "std::copysign((1.0 - e) / (1.0 + e), x)",
+        "1.0 / (1.0 + " + name + "_exp(0.0 - x))",
+        "x > 0.0 ? x : 0.0",
+        name + "_exp(0.0 - x * x)",
+        "x"
+    };
+#else
+    const std::string bodies[] = {
+        "1.0 + x / (1.0 + std::fabs(x))",
+        "std::tanh(x)",
+        "1.0 / (1.0 + std::exp(-x))",
+        "x > 0.0 ? x : 0.0",
+        "std::exp(-x * x)",
+        "x"
+    };
+#endif
+
+    for(uint64 f = 0; f != ne_identity; ++f) {
+        if(!used[f]) continue;
+        
+        out << "inline double " << name << "_" << names[f] << "(double x) {" << std::endl;
+
+#ifdef NE_FAST_ACTIVATIONS
+        if(f == ne_tanh)
+            out << "    double e = " << name << "_exp(-2.0 * std::fabs(x));" << std::endl;
+#endif
+
+        out << "    return " << bodies[f] << ";" << std::endl;
+        out << "}" << std::endl;
+        out << std::endl;
+    }
+    
+    out << "inline void " << name << "_reset(" << name << "_state* state) {" << std::endl;
+    out << "    for(unsigned i = 0; i != " << kept << "; ++i) {" << std::endl;
+    out << "        state->values[i] = 0.0;" << std::endl;
+    out << "    }" << std::endl;
+    out << "    " << std::endl;
+    out << "    state->phase = " << phases.size() << ";" << std::endl;
+    out << "}" << std::endl;
+    out << std::endl;
+    out << "inline void " << name << "_flush(" << name << "_state* state) {" << std::endl;
+    
+    if(bias != ne_codegen_none)
+        out << "    state->values[" << bias << "] = 1.0;" << std::endl;
+    
+    out << "    state->phase = 0;" << std::endl;
+    out << "}" << std::endl;
+    out << std::endl;
+    out << "inline void " << name << "_compute(" << name << "_state* state, const double* inputs, double* outputs) {" << std::endl;
+    out << "    double* v = state->values;" << std::endl;
+    out << "    " << std::endl;
+    
+    for(uint64 i = 0; i != inputs.size(); ++i) {
+        if(inputs[i] != ne_codegen_none)
+            out << "    v[" << inputs[i] << "] = inputs[" << i << "];" << std::endl;
+    }
+    
+    out << "    " << std::endl;
+    out << "    switch(state->phase) {" << std::endl;
+    
+    auto sum = [](const ne_step& s) {
+        std::string x = "0.0";
+        
+        for(const ne_term& t : s.terms) {
+            x += " + v[" + std::to_string(t.source) + "] * " + ne_literal(t.weight);
+        }
+        
+        return x;
+    };
+    
+    auto apply = [&name](const ne_step& s, const std::string& x) {
+        return s.function == ne_identity ? x : name + "_" + names[s.function] + "(" + x + ")";
+    };
+    
+    for(uint64 p = 0; p != phases.size(); ++p) {
+        const ne_phase& phase = phases[p];
+        
+        out << "        case " << p << ": {" << std::endl;
+        
+        for(const ne_sweep& sweep : phase.sweeps) {
+            if(forward) {
+                for(const ne_step& s : sweep) {
+                    out << "            v[" << s.node << "] = " << apply(s, sum(s)) << ";" << std::endl;
+                }
+                
+                continue;
+            }
+            
+            if(sweep.empty()) continue;
+            
+            out << "            {" << std::endl;
+            
+            for(const ne_step& s : sweep) {
+                out << "                const double s" << s.node << " = " << sum(s) << ";" << std::endl;
+            }
+            
+            for(const ne_step& s : sweep) {
+                out << "                v[" << s.node << "] = " << apply(s, "s" + std::to_string(s.node)) << ";" << std::endl;
+            }
+            
+            out << "            }" << std::endl;
+        }
+        
+        out << "            state->phase = " << phase.next << ";" << std::endl;
+        out << "            break;" << std::endl;
+        out << "        }" << std::endl;
+    }
+    
+    out << "        default:" << std::endl;
+    out << "            break;" << std::endl;
+    out << "    }" << std::endl;
+    out << "    " << std::endl;
+    
+    for(uint64 i = 0; i != outputs.size(); ++i) {
+        out << "    outputs[" << i << "] = v[" << outputs[i] << "];" << std::endl;
+    }
+    
+    out << "}" << std::endl;
+}
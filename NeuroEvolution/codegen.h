@@ -0,0 +1,99 @@
+//
+//  codegen.h
+//  NeuroEvolution
+//
+
+#ifndef ne_codegen_h
+#define ne_codegen_h
+
+#include "phenotype.h"
+#include <ostream>
+#include <string>
+
+/// The most distinct calls after a flush a generated network may unroll.
+const uint64 ne_codegen_phases = 64;
+
+const uint32 ne_codegen_none = 0xffffffff;
+
+/// Turns a genome into standalone C++ with no loops and no dependencies
+/// beyond <cmath>. Which nodes are active depends only on the topology and
+/// the calls since the last flush, so it is worked out here, call after
+/// call, until it repeats. Each distinct call becomes one phase of straight
+/// line code that sums exactly the active sources, in innovation order,
+/// with the weights as literals. Disabled genes and nodes no output depends
+/// on are left out.
+///
+/// The generated code computes bit for bit what ne_phenotype64 computes,
+/// starting from reset(), when built with the same NE_FAST_ACTIVATIONS
+/// setting as this library and without fused multiply-adds. It turns
+/// contraction off itself with pragmas for clang and GCC, and with
+/// STDC FP_CONTRACT elsewhere; a compiler that ignores all of them needs
+/// -ffp-contract=off or its equivalent.
+class ne_codegen
+{
+    
+public:
+    
+    ne_codegen(const ne_genome* genome, bool feed_forward = false);
+    
+    /// False if the activity never settles within ne_codegen_phases calls
+    /// or a weight is not finite, in which case write() writes nothing.
+    inline bool valid() const {
+        return ok;
+    }
+    
+    inline uint64 phase_count() const {
+        return phases.size();
+    }
+    
+    /// The nodes kept in the generated state.
+    inline uint64 node_count() const {
+        return kept;
+    }
+    
+    /// Writes `name`_state with `name`_reset, `name`_flush and
+    /// `name`_compute(state, inputs, outputs), which reads input_count()
+    /// inputs and writes output_count() outputs as one compute() does.
+    void write(std::ostream& out, const std::string& name) const;
+    
+private:
+    
+    struct ne_term
+    {
+        uint32 source;
+        float64 weight;
+    };
+    
+    struct ne_step
+    {
+        uint32 node;
+        uint8 function;
+        
+        std::vector<ne_term> terms;
+    };
+    
+    /// One sweep, or the single pass in feed-forward mode.
+    typedef std::vector<ne_step> ne_sweep;
+    
+    struct ne_phase
+    {
+        std::vector<ne_sweep> sweeps;
+        uint64 next;
+    };
+    
+    bool ok;
+    bool forward;
+    
+    uint64 kept;
+    
+    /// Where each input, the bias and each output live in the state, or
+    /// ne_codegen_none for inputs nothing reads.
+    std::vector<uint32> inputs;
+    std::vector<uint32> outputs;
+    
+    uint32 bias;
+    
+    std::vector<ne_phase> phases;
+};
+
+#endif /* ne_codegen_h */
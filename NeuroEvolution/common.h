@@ -12,54 +12,58 @@
 #include <cmath>
 #include <functional>
 #include <cfloat>
+#include <cstring>
 #include <iostream>
 
 typedef float float32;
 typedef double float64;
 
+/// The precision compiled networks evaluate in by default. Genomes keep
+/// their weights and values in float64 either way; NE_FLOAT32 only makes
+/// ne_phenotype and ne_group, and the networks genomes cache, single
+/// precision.
+#if defined(NE_FLOAT32)
+typedef float32 ne_real;
+#else
+typedef float64 ne_real;
+#endif
+
 typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef unsigned int uint32;
 typedef unsigned long uint64;
 
-inline uint32 rand32() {
-    return arc4random();
-}
+typedef signed char int8;
+typedef short int16;
+typedef int int32;
+typedef long int64;
 
-inline uint64 rand64() {
-    return rand32() | ((uint64)(rand32()) << 32);
+inline uint64 ne_mix(uint64 x) {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
 }
 
-inline float64 random(float64 a, float64 b) {
-    return (rand64() / (float64) (0xffffffffffffffff)) * (b - a) + a;
+/// Stored words are little-endian whatever the host is.
+inline uint64 ne_little(uint64 x) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(x);
+#else
+    return x;
+#endif
 }
 
-inline uint64 random(uint64 a, uint64 b) {
-    return random(0.0, 1.0) * (b - a) + a;
+inline uint64 ne_bits(float64 x) {
+    uint64 bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
 }
 
-inline float64 gaussian_random() {
-    static bool computed = false;
-    static float64 value;
-    
-    if(computed) {
-        computed = false;
-        return value;
-    }else{
-        float64 a, b, r, q;
-        
-        do {
-            a = random(-1.0, 1.0);
-            b = random(-1.0, 1.0);
-            r = a * a + b * b;
-        }  while (r >= 1.0 || r == 0.0);
-        
-        q = sqrt(-2.0 * log(r) / r);
-        
-        computed = true;
-        value = a * q;
-        return b * q;
-    }
+inline float64 ne_float(uint64 bits) {
+    float64 x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
 }
 
 #endif /* common_h */
@@ -7,6 +7,35 @@
 //
 
 #include "genome.h"
+#include "phenotype.h"
+#include <algorithm>
+#include <cstring>
+
+/// "NEGN"
+static const uint64 ne_genome_magic = 0x4e47454e;
+static const uint64 ne_genome_version = 1;
+
+static const uint64 ne_header_words = 8;
+static const uint64 ne_node_words = 2;
+static const uint64 ne_gene_words = 4;
+
+/// Converts a header to host order in place and returns the size of the
+/// records that follow it, or 0 if it cannot start a valid genome.
+static uint64 ne_check_header(uint64* header) {
+    for(uint64 i = 0; i != ne_header_words; ++i) {
+        header[i] = ne_little(header[i]);
+    }
+    
+    if(header[0] != ne_genome_magic || header[1] != ne_genome_version)
+        return 0;
+    
+    const uint64 limit = (uint64) 1 << 40;
+    
+    if(header[5] > limit || header[6] > limit)
+        return 0;
+    
+    return (header[5] * ne_node_words + header[6] * ne_gene_words) * sizeof(uint64);
+}
 
 void ne_genome::reset(uint64 inputs, uint64 outputs, ne_innovation_set* set, uint64* innovation) {
     input_size = inputs + 1;
@@ -25,7 +54,7 @@ void ne_genome::reset(uint64 inputs, uint64 outputs, ne_innovation_set* set, uin
     for(uint64 i = 0; i < input_size; ++i) {
         for(uint64 j = 0; j < output_size; ++j) {
             uint64 q = input_size + j;
-            ne_gene* gene = new ne_gene(nodes[i], nodes[q]);
+            ne_gene* gene = gene_arena.create(ne_gene(nodes[i], nodes[q]));
             
             ne_innovation p(gene, ne_new_gene);
             ne_get_innovation(set, innovation, nullptr, &p);
@@ -37,20 +66,33 @@ void ne_genome::reset(uint64 inputs, uint64 outputs, ne_innovation_set* set, uin
     
     bias_node = input_size - 1;
     activations = 1;
+    
+    _order();
+}
+
+ne_genome::ne_genome() {
+    NE_COUNT(ne_counter_created, 1);
+}
+
+ne_genome::~ne_genome() {
+    NE_COUNT(ne_counter_destroyed, 1);
+    _destory();
 }
 
 void ne_genome::_destory() {
+    current = false;
+    
     set.clear();
     nodes_map.clear();
     
-    for(ne_gene* gene : genes)
-        delete gene;
-    
-    for(ne_node* node : nodes)
-        delete node;
+    gene_arena.clear();
+    node_arena.clear();
     
     genes.clear();
     nodes.clear();
+    innovations.clear();
+    
+    ordered = true;
 }
 
 void ne_genome::flush() {
@@ -82,7 +124,7 @@ void ne_genome::compute() {
         for(ne_node* node : nodes) {
             if(node->computed) {
                 if(node->id >= q)
-                    node->value = ne_function(node->sum);
+                    node->value = ne_activate(node->function, node->sum);
                 else
                     node->value = node->sum;
             }
@@ -94,43 +136,224 @@ void ne_genome::compute() {
     }
 }
 
-void ne_genome::insert(ne_node *node) {
-    nodes_map.insert({node->id, node});
+uint64 ne_genome::_index(const ne_node* node) const {
+    return std::lower_bound(nodes.begin(), nodes.end(), node->id, [](const ne_node* a, uint64 id) {
+        return a->id < id;
+    }) - nodes.begin();
+}
+
+bool ne_genome::_topological(std::vector<uint64>& order, std::vector<uint64>& offsets, std::vector<const ne_gene*>& incoming) const {
+    uint64 size = nodes.size();
+    
+    std::vector<uint64> degree(size, 0), heads(size + 1, 0);
+    std::vector<uint64> targets;
+    
+    offsets.assign(size + 1, 0);
+    
+    for(const ne_gene* gene : genes) {
+        if(gene->weight != 0.0) {
+            ++offsets[_index(gene->j) + 1];
+            ++heads[_index(gene->i) + 1];
+        }
+    }
+    
+    for(uint64 i = 0; i != size; ++i) {
+        degree[i] = offsets[i + 1];
+        offsets[i + 1] += offsets[i];
+        heads[i + 1] += heads[i];
+    }
+    
+    incoming.resize(offsets[size]);
+    targets.resize(heads[size]);
+    
+    std::vector<uint64> in(offsets.begin(), offsets.end() - 1);
+    std::vector<uint64> out(heads.begin(), heads.end() - 1);
+    
+    for(const ne_gene* gene : genes) {
+        if(gene->weight != 0.0) {
+            uint64 i = _index(gene->i), j = _index(gene->j);
+            
+            incoming[in[j]++] = gene;
+            targets[out[i]++] = j;
+        }
+    }
+    
+    order.clear();
+    
+    for(uint64 i = 0; i != size; ++i) {
+        if(degree[i] == 0)
+            order.push_back(i);
+    }
+    
+    for(uint64 k = 0; k != order.size(); ++k) {
+        uint64 i = order[k];
+        
+        for(uint64 e = heads[i]; e != heads[i + 1]; ++e) {
+            if(--degree[targets[e]] == 0)
+                order.push_back(targets[e]);
+        }
+    }
     
-    std::vector<ne_node*>::iterator end = nodes.end();
+    return order.size() == size;
+}
+
+void ne_genome::_successors(std::vector<uint64>& heads, std::vector<uint64>& targets) const {
+    uint64 size = nodes.size();
     
-    while(end-- != nodes.begin()) {
-        if(node->id > (*end)->id) break;
+    heads.assign(size + 1, 0);
+    
+    for(const ne_gene* gene : genes) {
+        if(gene->weight != 0.0)
+            ++heads[_index(gene->i) + 1];
+    }
+    
+    for(uint64 i = 0; i != size; ++i) {
+        heads[i + 1] += heads[i];
     }
     
-    ++end;
-    nodes.insert(end, node);
+    targets.resize(heads[size]);
+    
+    std::vector<uint64> out(heads.begin(), heads.end() - 1);
+    
+    for(const ne_gene* gene : genes) {
+        if(gene->weight != 0.0)
+            targets[out[_index(gene->i)]++] = _index(gene->j);
+    }
+}
+
+bool ne_genome::_reaches(const std::vector<uint64>& heads, const std::vector<uint64>& targets, const ne_node* from, const ne_node* to) const {
+    uint64 goal = _index(to);
+    
+    std::vector<uint64> stack(1, _index(from));
+    std::vector<uint8> seen(nodes.size(), 0);
+    
+    seen[stack.back()] = 1;
+    
+    while(!stack.empty()) {
+        uint64 i = stack.back();
+        stack.pop_back();
+        
+        if(i == goal)
+            return true;
+        
+        for(uint64 e = heads[i]; e != heads[i + 1]; ++e) {
+            if(!seen[targets[e]]) {
+                seen[targets[e]] = 1;
+                stack.push_back(targets[e]);
+            }
+        }
+    }
+    
+    return false;
+}
+
+bool ne_genome::acyclic() const {
+    std::vector<uint64> order, offsets;
+    std::vector<const ne_gene*> incoming;
+    
+    return _topological(order, offsets, incoming);
+}
+
+ne_phenotype* ne_genome::network(bool feed_forward) {
+    if(compiled == nullptr)
+        compiled.reset(new ne_phenotype());
+    
+    if(!current || compiled->feed_forward() != feed_forward) {
+        compiled->compile(this, feed_forward);
+        current = true;
+    }
+    
+    compiled->activations = activations;
+    
+    return compiled.get();
+}
+
+void ne_genome::compute_forward() {
+    std::vector<uint64> order, offsets;
+    std::vector<const ne_gene*> incoming;
+    
+    if(!_topological(order, offsets, incoming)) {
+        compute();
+        return;
+    }
+    
+    uint64 q = input_size + output_size;
+    
+    for(uint64 i : order) {
+        if(offsets[i] == offsets[i + 1]) continue;
+        
+        ne_node* node = nodes[i];
+        
+        node->computed = false;
+        node->sum = 0.0;
+        
+        for(uint64 e = offsets[i]; e != offsets[i + 1]; ++e) {
+            const ne_gene* gene = incoming[e];
+            
+            if(gene->i->activated) {
+                node->computed = true;
+                node->sum += gene->i->value * gene->weight;
+            }
+        }
+        
+        if(node->computed) {
+            if(node->id >= q)
+                node->value = ne_activate(node->function, node->sum);
+            else
+                node->value = node->sum;
+        }
+        
+        node->activated = node->computed;
+    }
+}
+
+void ne_genome::insert(ne_node *node) {
+    if(!nodes.empty() && node->id < nodes.back()->id)
+        ordered = false;
+    
+    nodes_map.insert(node);
+    nodes.push_back(node);
 }
 
 void ne_genome::insert(ne_gene *gene) {
+    NE_COUNT(ne_counter_genes, 1);
+    
+    if(!genes.empty() && gene->innovation < genes.back()->innovation)
+        ordered = false;
+    
     set.insert(gene);
+    genes.push_back(gene);
+    innovations.push_back(gene->innovation);
+}
+
+void ne_genome::_order() {
+    if(ordered) return;
+    
+    std::sort(nodes.begin(), nodes.end(), [](const ne_node* a, const ne_node* b) {
+        return a->id < b->id;
+    });
     
-    std::vector<ne_gene*>::iterator end = genes.end();
+    std::sort(genes.begin(), genes.end(), [](const ne_gene* a, const ne_gene* b) {
+        return a->innovation < b->innovation;
+    });
     
-    while(end-- != genes.begin()) {
-        if(gene->innovation > (*end)->innovation) break;
+    for(uint64 i = 0; i != genes.size(); ++i) {
+        innovations[i] = genes[i]->innovation;
     }
     
-    ++end;
-    genes.insert(end, gene);
+    ordered = true;
 }
 
 ne_node* ne_genome::find_node(uint64 id, const ne_node& n) {
-    ne_nodes_map::iterator it = nodes_map.find(id);
+    ne_node* node = nodes_map.find(id);
     
-    if(it == nodes_map.end()) {
-        ne_node* node = new ne_node(n);
+    if(node == nullptr) {
+        node = node_arena.create(n);
         node->id = id;
         insert(node);
-        return node;
-    }else{
-        return it->second;
     }
+    
+    return node;
 }
 
 void ne_genome::mutate_weights(const ne_params& params) {
@@ -140,11 +363,27 @@ void ne_genome::mutate_weights(const ne_params& params) {
                 do {
                     gene->weight += random(-params.weights_mutation_power, params.weights_mutation_power);
                 } while (gene->weight == 0.0);
+                
+                if(current)
+                    compiled->update(gene);
             }
         }
     }
 }
 
+void ne_genome::mutate_function(const ne_params&) {
+    uint64 q = input_size + output_size;
+    uint64 size = nodes.size();
+    
+    if(size > q) {
+        ne_node* node = nodes[q + rand64() % (size - q)];
+        node->function = (node->function + 1 + rand32() % (ne_activation_count - 1)) % ne_activation_count;
+        
+        if(current)
+            compiled->update(node);
+    }
+}
+
 void ne_genome::mutate_add_node(ne_innovation_set *set, uint64 *innovation, uint64* node_ids, const ne_params& params) {
     uint64 gs = genes.size();
     
@@ -159,10 +398,19 @@ void ne_genome::mutate_add_node(ne_innovation_set *set, uint64 *innovation, uint
             
             ne_get_innovation(set, innovation, node_ids, &p);
             
+            /// This genome split the gene before, and mutate_add_gene has
+            /// since enabled it again. Splitting it again would repeat both
+            /// halves, with the same nodes and innovations.
+            if(nodes_map.find(p.id) != nullptr)
+                continue;
+            
             ne_node* node = find_node(p.id, ne_node());
             
+            if(current)
+                compiled->insert(node);
+            
             {
-                ne_gene* gene1 = new ne_gene(gene->i, node);
+                ne_gene* gene1 = gene_arena.create(ne_gene(gene->i, node));
                 
                 gene1->innovation = p.innovation1;
                 gene1->weight = 1.0;
@@ -171,7 +419,7 @@ void ne_genome::mutate_add_node(ne_innovation_set *set, uint64 *innovation, uint
             }
             
             {
-                ne_gene* gene2 = new ne_gene(node, gene->j);
+                ne_gene* gene2 = gene_arena.create(ne_gene(node, gene->j));
                 
                 gene2->innovation = p.innovation1 + 1;
                 gene2->weight = gene->weight;
@@ -181,39 +429,147 @@ void ne_genome::mutate_add_node(ne_innovation_set *set, uint64 *innovation, uint
             
             gene->weight = 0.0;
             
+            if(current) {
+                compiled->update(gene);
+                compiled->update(genes[genes.size() - 2]);
+                compiled->update(genes.back());
+            }
+            
             break;
         }
     }
+    
+    _order();
 }
 
 void ne_genome::mutate_add_gene(ne_innovation_set *set, uint64 *innovation, const ne_params& params) {
     uint64 size = nodes.size();
     
+    /// The enabled genes as adjacency lists, built on the first attempt
+    /// that needs them; the genes do not change until an attempt succeeds.
+    std::vector<uint64> heads, targets;
+    
     for(uint64 n = 0; n != params.timeout; ++n) {
         ne_gene q(nodes[rand64() % size], nodes[rand64() % size]);
         
-        ne_gene_set::iterator it = this->set.find(&q);
-        if(it != this->set.end()) {
-            if((*it)->weight == 0.0) {
-                (*it)->weight = gaussian_random();
+        if(params.feed_forward != 0) {
+            if(q.j->id < input_size)
+                continue;
+            
+            if(heads.empty())
+                _successors(heads, targets);
+            
+            if(_reaches(heads, targets, q.j, q.i))
+                continue;
+        }
+        
+        ne_gene* found = this->set.find(ne_gene_key::key(&q));
+        if(found != nullptr) {
+            if(found->weight == 0.0) {
+                found->weight = gaussian_random();
+                
+                if(current)
+                    compiled->update(found);
             }else{
                 continue;
             }
         }else{
-            ne_gene* gene = new ne_gene(q);
+            ne_gene* gene = gene_arena.create(q);
             
             ne_innovation p(gene, ne_new_gene);
             ne_get_innovation(set, innovation, nullptr, &p);
             ne_bind(gene, &p);
             
             insert(gene);
+            
+            if(current)
+                compiled->update(gene);
         }
         
         break;
     }
+    
+    _order();
+}
+
+void ne_genome::remap(uint64 base, const std::vector<uint64>& innovation_map, const std::vector<uint64>& node_map) {
+    bool changed = false;
+    
+    for(ne_node* node : nodes) {
+        if(node->id >= base) {
+            node->id = node_map[node->id - base];
+            changed = true;
+        }
+    }
+    
+    for(ne_gene* gene : genes) {
+        if(gene->innovation >= base) {
+            gene->innovation = innovation_map[gene->innovation - base];
+            changed = true;
+        }
+    }
+    
+    if(!changed) return;
+    
+    if(current)
+        compiled->remap(base, innovation_map, node_map);
+    
+    set.clear();
+    nodes_map.clear();
+    
+    for(ne_gene* gene : genes) {
+        set.insert(gene);
+    }
+    
+    for(ne_node* node : nodes) {
+        nodes_map.insert(node);
+    }
+    
+    ordered = false;
+    _order();
+}
+
+void ne_genome::_unsplit(uint64 id, uint64 innovation) {
+    ne_node* node = nodes_map.find(id);
+    ne_gene* split = nullptr;
+    
+    for(ne_gene* gene : genes) {
+        if(gene->innovation == innovation)
+            split = gene;
+    }
+    
+    uint64 kept = 0;
+    
+    for(ne_gene* gene : genes) {
+        if(gene->i == node && gene->j == split->j)
+            split->weight = gene->weight;
+        
+        if(gene->i != node && gene->j != node)
+            genes[kept++] = gene;
+    }
+    
+    genes.resize(kept);
+    nodes.erase(std::find(nodes.begin(), nodes.end(), node));
+    
+    set.clear();
+    nodes_map.clear();
+    innovations.clear();
+    
+    for(ne_gene* gene : genes) {
+        set.insert(gene);
+        innovations.push_back(gene->innovation);
+    }
+    
+    for(ne_node* n : nodes) {
+        nodes_map.insert(n);
+    }
+    
+    current = false;
 }
 
 ne_genome::ne_genome(const ne_genome& genome) {
+    NE_COUNT(ne_counter_created, 1);
+    
     *this = genome;
 }
 
@@ -227,15 +583,35 @@ ne_genome& ne_genome::operator = (const ne_genome &genome) {
     activations = genome.activations;
     eliminated = genome.eliminated;
     
+    gene_arena.reserve(genome.genes.size());
+    node_arena.reserve(genome.nodes.size());
+    
+    genes.reserve(genome.genes.size());
+    nodes.reserve(genome.nodes.size());
+    innovations.reserve(genome.genes.size());
+    
+    set.reserve(genome.genes.size());
+    nodes_map.reserve(genome.nodes.size());
+    
     for(ne_gene* gene : genome.genes) {
-        pass_down(new ne_gene(*gene));
+        pass_down(gene_arena.create(*gene));
+    }
+    
+    _order();
+    
+    if(genome.current) {
+        if(compiled == nullptr)
+            compiled.reset(new ne_phenotype());
+        
+        *compiled = *genome.compiled;
+        current = true;
     }
     
     return *this;
 }
 
-ne_genome* ne_genome::crossover(const ne_genome* A, const ne_genome* B, const ne_params& params) {
-    ne_genome* C = new ne_genome();
+void ne_genome::crossover(const ne_genome* A, const ne_genome* B, ne_genome* C, const ne_params& params) {
+    C->_destory();
     
     C->input_size = A->input_size;
     C->output_size = A->output_size;
@@ -285,60 +661,278 @@ ne_genome* ne_genome::crossover(const ne_genome* A, const ne_genome* B, const ne
         
         if(skip) continue;
         
-        ne_gene_set::iterator it = C->set.find(&gene);
-        if(it == C->set.end()) {
-            C->pass_down(new ne_gene(gene));
+        if(C->set.find(ne_gene_key::key(&gene)) == nullptr) {
+            C->pass_down(C->gene_arena.create(gene));
         }
     }
     
-    return C;
+    C->_order();
 }
 
-float64 ne_genome::distance(const ne_genome *A, const ne_genome *B, const ne_params& params) {
-    std::vector<ne_gene*>::const_iterator itA, itB;
+uint64 ne_genome::topology() const {
+    uint64 h = ne_mix(activations);
     
-    itA = A->genes.begin();
-    itB = B->genes.begin();
+    for(const ne_node* node : nodes) {
+        h = ne_mix(h ^ node->id) + node->function;
+    }
+    
+    for(const ne_gene* gene : genes) {
+        if(gene->weight != 0.0)
+            h = ne_mix(h ^ ne_hash(gene->i->id, gene->j->id)) + gene->innovation;
+    }
+    
+    return h;
+}
+
+bool ne_genome::same_topology(const ne_genome* A, const ne_genome* B) {
+    if(A->activations != B->activations || A->nodes.size() != B->nodes.size())
+        return false;
+    
+    for(uint64 i = 0; i != A->nodes.size(); ++i) {
+        if(A->nodes[i]->id != B->nodes[i]->id || A->nodes[i]->function != B->nodes[i]->function)
+            return false;
+    }
+    
+    std::vector<ne_gene*>::const_iterator itA = A->genes.begin(), itB = B->genes.begin();
+    
+    while(true) {
+        while(itA != A->genes.end() && (*itA)->weight == 0.0) ++itA;
+        while(itB != B->genes.end() && (*itB)->weight == 0.0) ++itB;
+        
+        if(itA == A->genes.end() || itB == B->genes.end())
+            return itA == A->genes.end() && itB == B->genes.end();
+        
+        if((*itA)->innovation != (*itB)->innovation || (*itA)->i->id != (*itB)->i->id || (*itA)->j->id != (*itB)->j->id)
+            return false;
+        
+        ++itA;
+        ++itB;
+    }
+}
+
+void ne_genome::signature(std::vector<uint64>& out) const {
+    out.clear();
+    out.push_back(activations);
+    
+    for(const ne_node* node : nodes) {
+        out.push_back(node->id);
+        out.push_back(node->function);
+    }
+    
+    for(const ne_gene* gene : genes) {
+        if(gene->weight != 0.0) {
+            out.push_back(gene->innovation);
+            out.push_back(gene->i->id);
+            out.push_back(gene->j->id);
+            out.push_back(ne_bits(gene->weight));
+        }
+    }
+}
+
+float64 ne_genome::distance(const ne_genome *A, const ne_genome *B, const ne_params& params, float64 bound) {
+    NE_COUNT(ne_counter_distance, 1);
     
+    const uint64* a = A->innovations.data();
+    const uint64* b = B->innovations.data();
+    
+    uint64 na = A->innovations.size();
+    uint64 nb = B->innovations.size();
+    
+    uint64 i = 0, j = 0;
     uint64 miss = 0;
     uint64 align = 0;
     
     float64 W = 0.0;
     
-    while(itA != A->genes.end() || itB != B->genes.end()) {
-        if(itA == A->genes.end()) {
-            ++miss;
-            ++itB;
-            continue;
-        }
-        
-        if(itB == B->genes.end()) {
-            ++miss;
-            ++itA;
-            continue;
-        }
+    while(i != na && j != nb) {
+        uint64 x = a[i];
+        uint64 y = b[j];
         
-        if((*itA)->innovation == (*itB)->innovation) {
-            W += fabs((*itA)->weight - (*itB)->weight);
+        if(x == y) {
+            W += fabs(A->genes[i]->weight - B->genes[j]->weight);
             ++align;
-            
-            ++itA;
-            ++itB;
-        }else if((*itA)->innovation < (*itB)->innovation) {
-            ++miss;
-            ++itA;
-        }else{
-            ++miss;
-            ++itB;
         }
+        
+        miss += x != y;
+        i += x <= y;
+        j += y <= x;
+        
+        uint64 ra = na - i, rb = nb - j;
+        uint64 least = miss + (ra > rb ? ra - rb : rb - ra);
+        
+        if(least >= bound)
+            return least;
     }
     
+    miss += (na - i) + (nb - j);
+    
+    if(miss >= bound)
+        return miss;
+    
     return miss + params.weights_power * W / (float64) align;
 }
 
+void ne_genome::_pack(std::vector<uint64>& words) const {
+    words.resize(ne_header_words + nodes.size() * ne_node_words + genes.size() * ne_gene_words);
+    
+    uint64* w = words.data();
+    
+    *w++ = ne_genome_magic;
+    *w++ = ne_genome_version;
+    *w++ = input_size;
+    *w++ = output_size;
+    *w++ = activations;
+    *w++ = nodes.size();
+    *w++ = genes.size();
+    *w++ = ne_bits(fitness);
+    
+    for(const ne_node* node : nodes) {
+        *w++ = node->id;
+        *w++ = node->function;
+    }
+    
+    for(const ne_gene* gene : genes) {
+        *w++ = gene->i->id;
+        *w++ = gene->j->id;
+        *w++ = gene->innovation;
+        *w++ = ne_bits(gene->weight);
+    }
+    
+    for(uint64& word : words) {
+        word = ne_little(word);
+    }
+}
+
+bool ne_genome::_unpack(const uint64* header, const uint8* body) {
+    _destory();
+    
+    input_size = header[2];
+    output_size = header[3];
+    activations = header[4];
+    fitness = ne_float(header[7]);
+    eliminated = false;
+    
+    bias_node = input_size - 1;
+    
+    uint64 node_count = header[5];
+    uint64 gene_count = header[6];
+    uint64 q = input_size + output_size;
+    
+    if(input_size == 0 || node_count < q) {
+        _destory();
+        return false;
+    }
+    
+    node_arena.reserve(node_count);
+    gene_arena.reserve(gene_count);
+    
+    nodes.reserve(node_count);
+    genes.reserve(gene_count);
+    innovations.reserve(gene_count);
+    
+    nodes_map.reserve(node_count);
+    set.reserve(gene_count);
+    
+    uint64 r[ne_gene_words];
+    
+    for(uint64 k = 0; k != node_count; ++k) {
+        memcpy(r, body, ne_node_words * sizeof(uint64));
+        body += ne_node_words * sizeof(uint64);
+        
+        ne_node node = ne_node();
+        node.function = (uint8) ne_little(r[1]);
+        
+        uint64 id = ne_little(r[0]);
+        
+        if(ne_little(r[1]) >= ne_activation_count || nodes_map.find(id) != nullptr) {
+            _destory();
+            return false;
+        }
+        
+        find_node(id, node);
+    }
+    
+    for(uint64 k = 0; k != gene_count; ++k) {
+        memcpy(r, body, ne_gene_words * sizeof(uint64));
+        body += ne_gene_words * sizeof(uint64);
+        
+        ne_node* i = nodes_map.find(ne_little(r[0]));
+        ne_node* j = nodes_map.find(ne_little(r[1]));
+        
+        if(i == nullptr || j == nullptr || set.find({ i->id, j->id }) != nullptr) {
+            _destory();
+            return false;
+        }
+        
+        ne_gene* gene = gene_arena.create(ne_gene(i, j));
+        gene->innovation = ne_little(r[2]);
+        gene->weight = ne_float(ne_little(r[3]));
+        
+        insert(gene);
+    }
+    
+    _order();
+    
+    for(uint64 k = 0; k != q; ++k) {
+        if(nodes[k]->id != k) {
+            _destory();
+            return false;
+        }
+    }
+    
+    return true;
+}
 
 void ne_genome::write(std::ofstream &out) const {
+    std::vector<uint64> words;
+    _pack(words);
+    
+    out.write((const char*) words.data(), words.size() * sizeof(uint64));
 }
 
-void ne_genome::read(std::ifstream &in) {
+void ne_genome::write(std::vector<uint8>& out) const {
+    std::vector<uint64> words;
+    _pack(words);
+    
+    uint64 size = out.size();
+    out.resize(size + words.size() * sizeof(uint64));
+    memcpy(out.data() + size, words.data(), words.size() * sizeof(uint64));
+}
+
+bool ne_genome::read(std::ifstream &in) {
+    uint64 header[ne_header_words];
+    
+    if(!in.read((char*) header, sizeof(header)))
+        return false;
+    
+    uint64 size = ne_check_header(header);
+    
+    if(size == 0)
+        return false;
+    
+    std::vector<uint8> body(size);
+    
+    if(!in.read((char*) body.data(), size))
+        return false;
+    
+    return _unpack(header, body.data());
+}
+
+uint64 ne_genome::read(const uint8* data, uint64 size) {
+    uint64 header[ne_header_words];
+    
+    if(size < sizeof(header))
+        return 0;
+    
+    memcpy(header, data, sizeof(header));
+    
+    uint64 body = ne_check_header(header);
+    
+    if(body == 0 || size - sizeof(header) < body)
+        return 0;
+    
+    if(!_unpack(header, data + sizeof(header)))
+        return 0;
+    
+    return sizeof(header) + body;
 }
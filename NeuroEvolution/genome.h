@@ -10,23 +10,28 @@
 #define ne_genome_h
 
 #include "ne.h"
+#include "arena.h"
+#include <memory>
 
 struct ne_species;
 
+template <class T>
+class ne_basic_phenotype;
+
+typedef ne_basic_phenotype<ne_real> ne_phenotype;
+
 class ne_genome
 {
     
 public:
     
-    ne_genome() {}
+    ne_genome();
     
     ne_genome(const ne_genome& genome);
     
     ne_genome& operator = (const ne_genome& genome);
     
-    ~ne_genome() {
-        _destory();
-    }
+    ~ne_genome();
     
     inline ne_node** inputs() {
         return nodes.data();
@@ -48,29 +53,60 @@ public:
         return a->fitness > b->fitness;
     }
     
+    /// Binary form: a versioned header of little-endian 64 bit words, then
+    /// fixed-width node records (id, function) and gene records (i, j,
+    /// innovation, weight). Loading is a single bulk read with no parsing.
     void write(std::ofstream& out) const;
-    void read(std::ifstream& in);
+    
+    /// Appends the binary form to `out`.
+    void write(std::vector<uint8>& out) const;
+    
+    bool read(std::ifstream& in);
+    
+    /// Loads from memory, such as a mapped file, and returns the number of
+    /// bytes consumed, or 0 if the data is not a valid genome.
+    uint64 read(const uint8* data, uint64 size);
     
     void _destory();
     
     void reset(uint64 inputs, uint64 outputs, ne_innovation_set* set, uint64* innovation);
     
     void flush();
-            
+    
     void compute();
-            
+    
+    /// One pass over the nodes in topological order, every node summing
+    /// all of its active sources. Falls back to compute() on a cyclic
+    /// genome.
+    void compute_forward();
+    
+    /// Whether the enabled genes form no cycle.
+    bool acyclic() const;
+    
+    /// The network compiled from this genome, built on first use or when
+    /// `feed_forward` differs from the last call. The mutations, remap and
+    /// copying keep it current, so a baby cloned from an evaluated parent
+    /// is never compiled from scratch; crossover and loading drop it.
+    ne_phenotype* network(bool feed_forward = false);
+    
     void mutate_weights(const ne_params& params);
     
     void mutate_add_node(ne_innovation_set* set, uint64* innovation, uint64* node_ids, const ne_params& params);
     
     void mutate_add_gene(ne_innovation_set* set, uint64* innovation, const ne_params& params);
     
+    void mutate_function(const ne_params& params);
+    
+    /// Renumbers every node id and innovation at or above `base` through
+    /// the tables, which are indexed by the old value minus `base`.
+    void remap(uint64 base, const std::vector<uint64>& innovation_map, const std::vector<uint64>& node_map);
+    
     void print() {
         std::cout << "Fitness: " << fitness << std::endl;
         std::cout << "Activations: " << activations << std::endl;
         
         for(ne_node* node : nodes) {
-            std::cout << "Node: " << node->id << " " << node->value << " " << node->activated << std::endl;
+            std::cout << "Node: " << node->id << " " << node->value << " " << node->activated << " " << (uint32) node->function << std::endl;
         }
         
         for(ne_gene* gene : genes) {
@@ -78,8 +114,24 @@ public:
         }
     }
     
-    static ne_genome* crossover(const ne_genome* A, const ne_genome* B, const ne_params& params);
-    static float64 distance(const ne_genome* A, const ne_genome* B, const ne_params& params);
+    /// A hash of everything compute() depends on except the weights: the
+    /// activations, the nodes with their functions and the enabled genes.
+    uint64 topology() const;
+    
+    /// Whether A and B differ at most in their weights, so one ne_group can
+    /// run both.
+    static bool same_topology(const ne_genome* A, const ne_genome* B);
+    
+    /// Everything compute() depends on, weights included, as words: the
+    /// activations, the nodes with their functions and the enabled genes
+    /// with the bits of their weights. Genomes with equal signatures compute
+    /// the same outputs.
+    void signature(std::vector<uint64>& out) const;
+    
+    static void crossover(const ne_genome* A, const ne_genome* B, ne_genome* C, const ne_params& params);
+    /// Stops as soon as the disjoint genes alone prove the distance is at
+    /// least `bound` and then returns that lower bound instead.
+    static float64 distance(const ne_genome* A, const ne_genome* B, const ne_params& params, float64 bound = DBL_MAX);
     
     float64 fitness;
     bool eliminated;
@@ -88,6 +140,14 @@ public:
     
 private:
     
+    template <class T>
+    friend class ne_basic_phenotype;
+    
+    template <class T>
+    friend class ne_basic_group;
+    
+    friend class ne_population;
+    
     ne_node* find_node(uint64 id, const ne_node& node);
     
     void insert(ne_node* node);
@@ -101,16 +161,46 @@ private:
         insert(gene);
     }
     
+    void _order();
+    
+    uint64 _index(const ne_node* node) const;
+    
+    bool _topological(std::vector<uint64>& order, std::vector<uint64>& offsets, std::vector<const ne_gene*>& incoming) const;
+    
+    /// The targets of each node's enabled genes, by node index: those of
+    /// nodes[i] are targets[heads[i]] up to targets[heads[i + 1]].
+    void _successors(std::vector<uint64>& heads, std::vector<uint64>& targets) const;
+    
+    bool _reaches(const std::vector<uint64>& heads, const std::vector<uint64>& targets, const ne_node* from, const ne_node* to) const;
+    
+    /// Takes back the split of the gene numbered `innovation` into node
+    /// `id`: drops the node and every gene touching it, and gives the gene
+    /// back the weight it passed on.
+    void _unsplit(uint64 id, uint64 innovation);
+    
+    void _pack(std::vector<uint64>& words) const;
+    
+    bool _unpack(const uint64* header, const uint8* body);
+    
     ne_gene_set set;
     ne_nodes_map nodes_map;
     
+    ne_arena<ne_gene> gene_arena;
+    ne_arena<ne_node> node_arena;
+    
     uint64 bias_node;
     
     uint64 input_size;
     uint64 output_size;
-        
+    
+    bool ordered = true;
+    
+    std::unique_ptr<ne_phenotype> compiled;
+    bool current = false;
+    
     std::vector<ne_node*> nodes;
     std::vector<ne_gene*> genes;
+    std::vector<uint64> innovations;
 };
 
 inline void ne_mutate(ne_genome* genome, ne_innovation_set* set, uint64* innovation, uint64* node_ids, const ne_params& params) {
@@ -126,7 +216,11 @@ inline void ne_mutate(ne_genome* genome, ne_innovation_set* set, uint64* innovat
         genome->mutate_weights(params);
     }
     
-    if(random(0.0, 1.0) < params.mutate_activation_prob) {
+    if(random(0.0, 1.0) < params.mutate_function_prob) {
+        genome->mutate_function(params);
+    }
+    
+    if(params.feed_forward == 0 && random(0.0, 1.0) < params.mutate_activation_prob) {
         if((rand32() & 1) || genome->activations == 1)
             ++genome->activations;
         else
@@ -0,0 +1,175 @@
+//
+//  group.cpp
+//  NeuroEvolution
+//
+
+#include "group.h"
+#include <algorithm>
+
+template <class T>
+void ne_basic_group<T>::compile(ne_genome* const* genomes, uint64 count, bool feed_forward) {
+    shape.compile(genomes[0], feed_forward);
+    
+    lanes = count;
+    
+    uint64 size = shape.values.size();
+    
+    std::vector<uint64> edges;
+    std::vector<uint32> slots;
+    
+    for(const ne_gene* gene : genomes[0]->genes) {
+        if(gene->weight != 0.0)
+            edges.push_back(shape._find(shape._slot(gene->j->id), gene->innovation));
+    }
+    
+    for(const ne_node* node : genomes[0]->nodes) {
+        slots.push_back(shape._slot(node->id));
+    }
+    
+    weights.assign(shape.tail * lanes, 0.0);
+    
+    values.resize(size * lanes);
+    sums.resize(size * lanes);
+    
+    activated.assign(shape.activated.begin(), shape.activated.end());
+    computed.resize(size);
+    
+    for(uint64 l = 0; l != lanes; ++l) {
+        const ne_genome* genome = genomes[l];
+        uint64 k = 0;
+        
+        for(const ne_gene* gene : genome->genes) {
+            if(gene->weight != 0.0)
+                weights[edges[k++] * lanes + l] = gene->weight;
+        }
+        
+        for(uint64 i = 0; i != size; ++i) {
+            values[slots[i] * lanes + l] = genome->nodes[i]->value;
+        }
+    }
+}
+
+template <class T>
+void ne_basic_group<T>::reset() {
+    std::fill(values.begin(), values.end(), 0.0);
+    std::fill(activated.begin(), activated.end(), 0);
+}
+
+template <class T>
+void ne_basic_group<T>::flush() {
+    uint64 size = shape.values.size();
+    
+    for(uint64 j = 0; j != size; ++j) {
+        activated[j] = j < shape.input_size;
+    }
+    
+    std::fill(values.begin() + shape.bias_node * lanes, values.begin() + (shape.bias_node + 1) * lanes, 1.0);
+}
+
+/// Only the edges from active slots are walked, each as one dense
+/// multiply-add over the lanes.
+template <class T>
+void ne_basic_group<T>::compute(const T* inputs, T* outputs) {
+    uint64 size = shape.values.size(), n = 0;
+    uint64 inputs_size = shape.input_size - 1;
+    uint64 hidden_begin = shape.hidden_begin;
+    
+    const typename ne_basic_phenotype<T>::ne_range* range = shape.ranges.data();
+    const uint32* source = shape.sources.data();
+    const T* weight = weights.data();
+    
+    T* value = values.data();
+    T* sum = sums.data();
+    uint8* active = activated.data();
+    uint8* next = computed.data();
+    
+    for(uint64 i = 0; i != inputs_size; ++i) {
+        for(uint64 l = 0; l != lanes; ++l) {
+            value[i * lanes + l] = inputs[l * inputs_size + i];
+        }
+    }
+    
+    if(shape.forward) {
+        for(uint32 j : shape.order) {
+            if(range[j].begin == range[j].end) continue;
+            
+            T* s = sum + j * lanes;
+            uint8 c = 0;
+            
+            std::fill(s, s + lanes, 0.0);
+            
+            for(uint64 e = range[j].begin; e != range[j].end; ++e) {
+                if(!active[source[e]]) continue;
+                
+                const T* u = value + source[e] * lanes;
+                const T* w = weight + e * lanes;
+                
+                c = 1;
+                
+                for(uint64 l = 0; l != lanes; ++l) {
+                    s[l] += u[l] * w[l];
+                }
+            }
+            
+            if(c) {
+                if(j >= hidden_begin)
+                    ne_activate(shape.functions[j], s, lanes);
+                
+                std::copy(s, s + lanes, value + j * lanes);
+            }
+            
+            active[j] = c;
+        }
+        
+        n = shape.activations;
+    }
+    
+    while(n != shape.activations) {
+        for(uint64 j = 0; j != size; ++j) {
+            T* s = sum + j * lanes;
+            uint8 c = 0;
+            
+            std::fill(s, s + lanes, 0.0);
+            
+            for(uint64 e = range[j].begin; e != range[j].end; ++e) {
+                if(!active[source[e]]) continue;
+                
+                const T* u = value + source[e] * lanes;
+                const T* w = weight + e * lanes;
+                
+                c = 1;
+                
+                for(uint64 l = 0; l != lanes; ++l) {
+                    s[l] += u[l] * w[l];
+                }
+            }
+            
+            next[j] = c;
+        }
+        
+        for(const typename ne_basic_phenotype<T>::ne_run& run : shape.runs) {
+            ne_activate(run.function, sum + run.begin * lanes, (run.end - run.begin) * lanes);
+        }
+        
+        for(uint64 j = 0; j != size; ++j) {
+            if(next[j])
+                std::copy(sum + j * lanes, sum + (j + 1) * lanes, value + j * lanes);
+        }
+        
+        std::swap(active, next);
+        
+        ++n;
+    }
+    
+    if(active != activated.data())
+        activated.swap(computed);
+    
+    for(uint64 i = 0; i != shape.output_size; ++i) {
+        for(uint64 l = 0; l != lanes; ++l) {
+            outputs[l * shape.output_size + i] = value[(shape.input_size + i) * lanes + l];
+        }
+    }
+}
+
+template class ne_basic_group<float32>;
+template class ne_basic_group<float64>;
@@ -0,0 +1,77 @@
+//
+//  group.h
+//  NeuroEvolution
+//
+
+#ifndef ne_group_h
+#define ne_group_h
+
+#include "phenotype.h"
+
+/// Genomes of one topology, as ne_genome::same_topology tells, run as one
+/// network with a lane per genome. The edge structure is walked once per
+/// step while weights, values and activations are stacked across lanes,
+/// so every inner loop is a dense loop over genomes. Which nodes are active
+/// depends only on the topology and the steps since the last flush, so it
+/// is kept once for all lanes, starting from the first genome's. Each lane
+/// computes exactly what ne_phenotype::compute gives its genome, step
+/// after step, in the same precision T.
+template <class T>
+class ne_basic_group
+{
+    
+public:
+    
+    ne_basic_group() {}
+    
+    ne_basic_group(ne_genome* const* genomes, uint64 count, bool feed_forward = false) {
+        compile(genomes, count, feed_forward);
+    }
+    
+    void compile(ne_genome* const* genomes, uint64 count, bool feed_forward = false);
+    
+    inline uint64 lane_count() const {
+        return lanes;
+    }
+    
+    inline uint64 input_count() const {
+        return shape.input_count();
+    }
+    
+    inline uint64 output_count() const {
+        return shape.output_count();
+    }
+    
+    /// Zeroes every value and activation in every lane.
+    void reset();
+    
+    void flush();
+    
+    /// One step of every lane. Reads `input_count()` values per lane from
+    /// its row of `inputs` into the input nodes, computes as
+    /// ne_phenotype::compute does and writes `output_count()` values to
+    /// its row of `outputs`. State carries over to the next step.
+    void compute(const T* inputs, T* outputs);
+    
+private:
+    
+    ne_basic_phenotype<T> shape;
+    
+    uint64 lanes = 0;
+    
+    /// Edge major, lanes innermost, in the order of shape's edge arrays.
+    std::vector<T> weights;
+    
+    std::vector<T> values;
+    std::vector<T> sums;
+    
+    /// One flag per slot, shared by the lanes.
+    std::vector<uint8> activated;
+    std::vector<uint8> computed;
+};
+
+typedef ne_basic_group<ne_real> ne_group;
+typedef ne_basic_group<float32> ne_group32;
+typedef ne_basic_group<float64> ne_group64;
+
+#endif /* ne_group_h */
@@ -0,0 +1,266 @@
+//
+//  island.cpp
+//  NeuroEvolution
+//
+
+#include "island.h"
+#include <cstdio>
+#include <iostream>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+static const int ne_send_flags = MSG_NOSIGNAL;
+#else
+static const int ne_send_flags = 0;
+#endif
+
+static bool ne_write(int fd, const uint8* data, uint64 size) {
+    while(size != 0) {
+        ssize_t n = send(fd, data, size, ne_send_flags);
+        
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        
+        data += n;
+        size -= n;
+    }
+    
+    return true;
+}
+
+static bool ne_read(int fd, uint8* data, uint64 size) {
+    while(size != 0) {
+        ssize_t n = recv(fd, data, size, 0);
+        
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        
+        data += n;
+        size -= n;
+    }
+    
+    return true;
+}
+
+/// A message is its size as a little-endian 64 bit word, then its bytes.
+static bool ne_send(int fd, const std::vector<uint8>& message) {
+    uint64 size = ne_little((uint64) message.size());
+    return ne_write(fd, (const uint8*) &size, sizeof(size)) && ne_write(fd, message.data(), message.size());
+}
+
+static bool ne_receive(int fd, std::vector<uint8>& message) {
+    uint64 size;
+    
+    if(!ne_read(fd, (uint8*) &size, sizeof(size)))
+        return false;
+    
+    message.resize(ne_little(size));
+    return ne_read(fd, message.data(), message.size());
+}
+
+ne_islands::ne_islands(const ne_params& _params, uint64 input_size, uint64 output_size, uint64 count) : params(_params), input_size(input_size), output_size(output_size), count(std::max((uint64) 1, count)) {
+    if(params.seed == 0)
+        params.seed = rand64();
+    
+    if(params.threads == 0)
+        params.threads = std::max((uint64) 1, (uint64) std::thread::hardware_concurrency() / this->count);
+}
+
+void ne_islands::_clear() {
+    for(ne_genome* g : champions) {
+        delete g;
+    }
+    
+    champions.clear();
+}
+
+bool ne_islands::_island(uint64 island, uint64 generations, int in, int out, int parent, const ne_evaluation& evaluate, const ne_report& report) const {
+    ne_params local = params;
+    local.seed = ne_mix(params.seed + island);
+    
+    ne_population population;
+    population.reset(local, input_size, output_size);
+    
+    uint64 source = (island + count - 1) % count;
+    
+    std::vector<uint8> message, arrival;
+    
+    ne_genome* best = nullptr;
+    bool ok = true;
+    
+    for(uint64 n = 0; n != generations; ++n) {
+        evaluate(&population, island);
+        
+        best = population.select();
+        
+        if(report)
+            report(&population, island, best);
+        
+        if(n + 1 == generations)
+            break;
+        
+        bool migrate = count != 1 && interval != 0 && (n + 1) % interval == 0;
+        
+        if(migrate) {
+            message.clear();
+            population.emigrate(message, migrants);
+        }
+        
+        population.reproduce();
+        
+        if(!migrate) continue;
+        
+        /// Every island sends before it receives, so the send runs on its
+        /// own thread or a full socket buffer would stall the whole ring.
+        bool sent = false;
+        
+        std::thread sender([&sent, &message, out] {
+            sent = ne_send(out, message);
+        });
+        
+        bool received = ne_receive(in, arrival);
+        
+        sender.join();
+        
+        if(!sent || !received || !population.immigrate(arrival.data(), arrival.size(), source)) {
+            ok = false;
+            break;
+        }
+    }
+    
+    message.clear();
+    
+    if(ok && best != nullptr)
+        best->write(message);
+    
+    return ne_send(parent, message) && ok;
+}
+
+bool ne_islands::run(uint64 generations, const ne_evaluation& evaluate, const ne_report& report) {
+    _clear();
+    
+    champions.resize(count, nullptr);
+    
+    /// Island k sends on ring[2k] and island k + 1 receives on ring[2k + 1];
+    /// island k reports on results[2k + 1] and the caller reads results[2k].
+    std::vector<int> ring(count * 2, -1), results(count * 2, -1);
+    
+    bool ok = true;
+    
+    for(uint64 k = 0; ok && k != count; ++k) {
+        ok = socketpair(AF_UNIX, SOCK_STREAM, 0, &ring[k * 2]) == 0 && socketpair(AF_UNIX, SOCK_STREAM, 0, &results[k * 2]) == 0;
+    }
+    
+    auto in = [this, &ring](uint64 k) {
+        return ring[((k + count - 1) % count) * 2 + 1];
+    };
+    
+    auto close_all = [](std::vector<int>& fds) {
+        for(int& fd : fds) {
+            if(fd != -1)
+                close(fd);
+            
+            fd = -1;
+        }
+    };
+    
+    std::vector<pid_t> children;
+    std::vector<std::thread> threads;
+    
+    /// fork() copies only the calling thread, so a child of a process
+    /// with live workers could inherit a mutex one of them holds.
+    bool forked = processes && ne_thread_pool::running() == 0;
+    
+    if(ok && forked) {
+        /// Buffered output would otherwise be written once by every child.
+        std::cout.flush();
+        fflush(stdout);
+        
+        for(uint64 k = 0; k != count; ++k) {
+            pid_t pid = fork();
+            
+            if(pid < 0) {
+                ok = false;
+                break;
+            }
+            
+            if(pid == 0) {
+                int fds[3] = { in(k), ring[k * 2], results[k * 2 + 1] };
+                
+                /// Only its own ends stay open, so a dead neighbour is seen
+                /// as the end of its socket.
+                for(uint64 i = 0; i != count * 2; ++i) {
+                    if(ring[i] != fds[0] && ring[i] != fds[1]) close(ring[i]);
+                    if(results[i] != fds[2]) close(results[i]);
+                }
+                
+                bool good = _island(k, generations, fds[0], fds[1], fds[2], evaluate, report);
+                
+                std::cout.flush();
+                fflush(stdout);
+                
+                _exit(good ? 0 : 1);
+            }
+            
+            children.push_back(pid);
+        }
+        
+        close_all(ring);
+        
+        for(uint64 k = 0; k != count; ++k) {
+            close(results[k * 2 + 1]);
+            results[k * 2 + 1] = -1;
+        }
+    }else if(ok) {
+        for(uint64 k = 0; k != count; ++k) {
+            threads.emplace_back([this, k, generations, &ring, &results, &in, &evaluate, &report] {
+                _island(k, generations, in(k), ring[k * 2], results[k * 2 + 1], evaluate, report);
+            });
+        }
+    }
+    
+    std::vector<uint8> message;
+    
+    for(uint64 k = 0; ok && k != count; ++k) {
+        ne_genome* genome = new ne_genome();
+        
+        if(ne_receive(results[k * 2], message) && !message.empty() && genome->read(message.data(), message.size()) != 0) {
+            champions[k] = genome;
+        }else{
+            delete genome;
+            ok = false;
+        }
+    }
+    
+    /// A failed island leaves the other threads blocked on the ring, and
+    /// closing a socket does not wake a thread reading it.
+    if(!ok && !forked) {
+        for(int fd : ring) {
+            if(fd != -1) shutdown(fd, SHUT_RDWR);
+        }
+        
+        for(int fd : results) {
+            if(fd != -1) shutdown(fd, SHUT_RDWR);
+        }
+    }
+    
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+    
+    for(pid_t pid : children) {
+        int status = 0;
+        
+        while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+        
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    
+    close_all(ring);
+    close_all(results);
+    
+    return ok;
+}
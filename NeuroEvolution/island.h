@@ -0,0 +1,81 @@
+//
+//  island.h
+//  NeuroEvolution
+//
+
+#ifndef ne_island_h
+#define ne_island_h
+
+#include "population.h"
+
+/// Several populations evolving apart, each with its own seed and
+/// innovation counters, that pass their fittest genomes around a ring every
+/// `interval` generations. Each island runs in a forked process, or in a
+/// thread when `processes` is false or a thread pool already has workers
+/// in this process, and talks to its neighbours over Unix socketpairs in
+/// the binary genome format. Islands never wait on one
+/// another's reproduce(), only on a migration.
+///
+/// With params.threads at 0 the hardware threads are split between the
+/// islands. The island seeds derive from params.seed, which is drawn once
+/// here when 0.
+class ne_islands
+{
+    
+public:
+    
+    /// Scores every genome of one island's population for a generation, as
+    /// ne_population::evaluate or evaluate_groups does. In thread mode this
+    /// and the report run on several islands at once.
+    typedef std::function<void (ne_population* population, uint64 island)> ne_evaluation;
+    
+    /// Called on the island after each select() with its best genome.
+    typedef std::function<void (ne_population* population, uint64 island, const ne_genome* best)> ne_report;
+    
+    ne_islands(const ne_params& params, uint64 input_size, uint64 output_size, uint64 count);
+    
+    ~ne_islands() {
+        _clear();
+    }
+    
+    ne_islands(const ne_islands& islands) = delete;
+    
+    ne_islands& operator = (const ne_islands& islands) = delete;
+    
+    inline uint64 size() const {
+        return count;
+    }
+    
+    /// Runs `generations` generations on every island and collects their
+    /// champions. Returns false if any island failed or died.
+    bool run(uint64 generations, const ne_evaluation& evaluate, const ne_report& report = nullptr);
+    
+    /// The fittest genome of each island's last generation, after run(), or
+    /// nullptr for an island that failed.
+    std::vector<ne_genome*> champions;
+    
+    /// Generations between migrations; 0 never migrates.
+    uint64 interval = 10;
+    
+    /// Genomes each island sends per migration.
+    uint64 migrants = 2;
+    
+    bool processes = true;
+    
+private:
+    
+    /// One island's whole run, reading immigrants from `in`, writing
+    /// emigrants to `out` and its champion to `parent`.
+    bool _island(uint64 island, uint64 generations, int in, int out, int parent, const ne_evaluation& evaluate, const ne_report& report) const;
+    
+    void _clear();
+    
+    ne_params params;
+    
+    uint64 input_size;
+    uint64 output_size;
+    
+    uint64 count;
+};
+
+#endif /* ne_island_h */
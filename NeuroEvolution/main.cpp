@@ -7,7 +7,12 @@
 //
 
 #include <iostream>
+#include <sstream>
 #include "population.h"
+#include "group.h"
+#include "quantize.h"
+#include "codegen.h"
+#include "island.h"
 
 ne_population population;
 
@@ -25,7 +30,27 @@ struct Obj
     
     double fitness;
     
+    /// When set, run(ne_genome*) appends every input row it feeds.
+    std::vector<float64>* record = nullptr;
+    
     virtual void run(ne_genome* gen) = 0;
+    
+    /// Runs genomes of one topology as one ne_group, drawing each one's
+    /// randomness from its own stream, and sets their fitness.
+    virtual void run(ne_genome* const* genomes, ne_rng* streams, uint64 count) = 0;
+    
+    /// A lone genome runs on its own cached network instead.
+    void score(ne_genome* const* genomes, ne_rng* streams, uint64 count) {
+        if(count != 1) {
+            run(genomes, streams, count);
+            return;
+        }
+        
+        ne_stream_scope scope(streams);
+        
+        run(genomes[0]);
+        genomes[0]->fitness = fitness;
+    }
 };
 
 struct Pendulum : public Obj
@@ -67,60 +92,247 @@ struct Pendulum : public Obj
         va = gaussian_random() * stdev;
     }
     
+    void observe(ne_real* inputs) const {
+        float64 s, c;
+        ne_trig<ne_scalar>(a, &s, &c);
+        
+        inputs[0] = vx;
+        inputs[1] = x;
+        inputs[2] = c;
+        inputs[3] = s;
+        inputs[4] = va;
+    }
+    
+    double control(double output) const {
+        double action = output < -1.0 ? -1.0 : (output > 1.0 ? 1.0 : output);
+        
+        return action * f;
+    }
+    
+    /// One time step of S::width carts whose states are at the pointers.
+    /// `reward` receives 0.5 * (cos(a) + 1) of the new angle. The equations
+    /// are evaluated in the same order for every width, so a cart takes the
+    /// same path alone or in a batch.
+    template <class S>
+    void advance(float64* px, float64* pvx, float64* pa, float64* pva, const float64* paction, float64* reward) const {
+        typedef typename S::type type;
+        
+        type vx = S::load(pvx);
+        type va = S::load(pva);
+        type action = S::load(paction);
+        
+        type s, c;
+        ne_trig<S>(S::load(pa), &s, &c);
+        
+        type va2 = S::mul(va, va);
+        type sc = S::mul(s, c);
+        type c2 = S::mul(c, c);
+        
+        type nx = S::add(S::add(S::mul(S::mul(S::set1(-2.0 * m_p * l), va2), s), S::mul(S::set1(3.0 * m_p * g), sc)), S::mul(S::set1(4.0), action));
+        type vvx = S::div(S::sub(nx, S::mul(S::set1(4.0 * b), vx)), S::sub(S::set1(4.0 * m), S::mul(S::set1(3.0 * m_p), c2)));
+        
+        type na = S::add(S::mul(S::mul(S::set1(-3.0 * m_p * l), va2), sc), S::mul(S::set1(6.0 * m * g), s));
+        type vva = S::div(S::add(na, S::mul(S::mul(S::set1(6.0), S::sub(action, S::mul(S::set1(b), vx))), c)), S::sub(S::set1(4.0 * l * m), S::mul(S::set1(3.0 * m_p * l), c2)));
+        
+        type dt = S::set1(time_step);
+        
+        vx = S::add(vx, S::mul(vvx, dt));
+        va = S::add(va, S::mul(vva, dt));
+        
+        type a = S::add(S::load(pa), S::mul(va, dt));
+        
+        S::store(pvx, vx);
+        S::store(pva, va);
+        S::store(px, S::add(S::load(px), S::mul(vx, dt)));
+        S::store(pa, a);
+        
+        ne_trig<S>(a, &s, &c);
+        S::store(reward, S::mul(S::set1(0.5), S::add(c, S::set1(1.0))));
+    }
+    
+    /// Advances one time step and returns whether the cart is still on the
+    /// track.
+    bool step(double action) {
+        double reward;
+        
+        advance<ne_scalar>(&x, &vx, &a, &va, &action, &reward);
+        
+        if(x < -xt || x > xt)
+            return false;
+        
+        fitness += reward;
+        
+        return true;
+    }
+    
     void run(ne_genome* gen) {
         fitness = 0.0;
         
-        gen->flush();
+        ne_phenotype& net = *gen->network(params.feed_forward != 0);
+        
+        net.reset();
+        net.flush();
         
         reset();
         
-        ne_node** inputs = gen->inputs();
-        ne_node** outputs = gen->outputs();
+        ne_real* inputs = net.inputs();
+        ne_real* outputs = net.outputs();
         
         for(int i = 0; i < time_limit; ++i) {
-            double c = cos(a);
-            double s = sin(a);
-
             double action = 0.0;
             
             if((i % 2) == 0) {
-                inputs[0]->value = vx;
-                inputs[1]->value = x;
-                inputs[2]->value = c;
-                inputs[3]->value = s;
-                inputs[4]->value = va;
+                observe(inputs);
                 
-                gen->compute();
+                if(record != nullptr)
+                    record->insert(record->end(), inputs, inputs + input_size);
                 
-                action = outputs[0]->value;
+                net.compute();
                 
-                action = action < -1.0 ? -1.0 : (action > 1.0 ? 1.0 : action);
-                
-                action *= f;
+                action = control(outputs[0]);
             }
             
-            double va2 = va * va;
-            double sc = s * c;
-            double c2 = c * c;
+            if(!step(action))
+                break;
+        }
+    }
+    
+    void run(ne_genome* const* genomes, ne_rng* streams, uint64 count);
+
+};
+
+/// Cart-poles as a structure of arrays, stepped together with vector math.
+/// A cart that leaves the track is swapped behind the active ones, so each
+/// step runs densely over the carts still going.
+struct Carts
+{
+    Pendulum model;
+    
+    std::vector<float64> x;
+    std::vector<float64> vx;
+    std::vector<float64> a;
+    std::vector<float64> va;
+    
+    std::vector<float64> action;
+    std::vector<float64> reward;
+    
+    /// The lane each active cart belongs to, and each lane's fitness.
+    std::vector<uint64> lanes;
+    std::vector<float64> fitness;
+    
+    uint64 active;
+    
+    /// Draws each lane's start from its own stream, as Pendulum::reset does.
+    void reset(ne_rng* streams, uint64 count) {
+        x.resize(count);
+        vx.resize(count);
+        a.resize(count);
+        va.resize(count);
+        
+        action.resize(count);
+        reward.resize(count);
+        
+        lanes.resize(count);
+        fitness.assign(count, 0.0);
+        
+        for(uint64 k = 0; k != count; ++k) {
+            ne_stream_scope scope(streams + k);
+            
+            model.reset();
             
-            double vvx = (-2.0 * m_p * l * va2 * s + 3.0 * m_p * g * sc + 4.0 * action - 4.0 * b * vx) / (4.0 * m - 3.0 * m_p * c2);
-            double vva = (-3.0 * m_p * l * va2 * sc + 6.0 * m * g * s + 6.0 * (action - b * vx) * c) / (4.0 * l * m - 3.0 * m_p * l * c2);
+            x[k] = model.x;
+            vx[k] = model.vx;
+            a[k] = model.a;
+            va[k] = model.va;
             
-            vx = vx + vvx * time_step;
-            va = va + vva * time_step;
+            lanes[k] = k;
+        }
+        
+        active = count;
+    }
+    
+    /// Writes each active cart's observation to its lane's row.
+    void observe(ne_real* inputs) const {
+        for(uint64 k = 0; k != active; ++k) {
+            ne_real* row = inputs + lanes[k] * Pendulum::input_size;
             
-            x = x + vx * time_step;
-            a = a + va * time_step;
+            float64 s, c;
+            ne_trig<ne_scalar>(a[k], &s, &c);
             
-            if(x < -xt || x > xt)
-                break;
+            row[0] = vx[k];
+            row[1] = x[k];
+            row[2] = c;
+            row[3] = s;
+            row[4] = va[k];
+        }
+    }
+    
+    /// Steps every active cart under its lane's row of `outputs`, or with
+    /// no force if `outputs` is null.
+    void step(const ne_real* outputs) {
+        for(uint64 k = 0; k != active; ++k) {
+            action[k] = outputs != nullptr ? model.control(outputs[lanes[k] * Pendulum::output_size]) : 0.0;
+        }
+        
+        uint64 k = 0;
+        
+        for(; k + ne_vector::width <= active; k += ne_vector::width) {
+            model.advance<ne_vector>(&x[k], &vx[k], &a[k], &va[k], &action[k], &reward[k]);
+        }
+        
+        for(; k != active; ++k) {
+            model.advance<ne_scalar>(&x[k], &vx[k], &a[k], &va[k], &action[k], &reward[k]);
+        }
+        
+        for(k = 0; k < active;) {
+            if(x[k] < -model.xt || x[k] > model.xt) {
+                _retire(k);
+                continue;
+            }
             
-            fitness += 0.5 * (cos(a) + 1.0);
+            fitness[lanes[k]] += reward[k];
+            ++k;
         }
     }
     
+    void _retire(uint64 k) {
+        --active;
+        
+        std::swap(x[k], x[active]);
+        std::swap(vx[k], vx[active]);
+        std::swap(a[k], a[active]);
+        std::swap(va[k], va[active]);
+        std::swap(reward[k], reward[active]);
+        std::swap(lanes[k], lanes[active]);
+    }
 };
 
+void Pendulum::run(ne_genome* const* genomes, ne_rng* streams, uint64 count) {
+    ne_group net(genomes, count, params.feed_forward != 0);
+    
+    net.flush();
+    
+    Carts carts;
+    carts.reset(streams, count);
+    
+    std::vector<ne_real> inputs(count * input_size);
+    std::vector<ne_real> outputs(count * output_size);
+    
+    for(int i = 0; i < time_limit && carts.active != 0; ++i) {
+        if((i % 2) == 0) {
+            carts.observe(inputs.data());
+            net.compute(inputs.data(), outputs.data());
+            carts.step(outputs.data());
+        }else{
+            carts.step(nullptr);
+        }
+    }
+    
+    for(uint64 k = 0; k != count; ++k) {
+        genomes[k]->fitness = carts.fitness[k];
+    }
+}
+
 struct XOR : public Obj
 {
     static const uint64 input_size = 2;
@@ -129,26 +341,59 @@ struct XOR : public Obj
     void run(ne_genome* gen) {
         fitness = 0.0;
         
+        ne_phenotype& net = *gen->network(params.feed_forward != 0);
+        
+        net.reset();
+        
+        ne_real inputs[8] = { 0.0, 0.0, 0.0, 1.0, 1.0, 0.0, 1.0, 1.0 };
+        ne_real outputs[4];
+        
+        net.compute(inputs, outputs, 4);
+        
+        if(record != nullptr)
+            record->insert(record->end(), inputs, inputs + 8);
+        
         for(int a = 0; a < 2; ++a) {
             for(int b = 0; b < 2; ++b) {
-                gen->flush();
-                
                 int c = a ^ b;
                 
-                ne_node** inputs = gen->inputs();
-                ne_node** outputs = gen->outputs();
+                double d = outputs[a * 2 + b] - c;
+                fitness += 1.0 - d * d;
+            }
+        }
+        
+        fitness *= 0.25;
+    }
+    
+    void run(ne_genome* const* genomes, ne_rng*, uint64 count) {
+        ne_group net(genomes, count, params.feed_forward != 0);
+        
+        std::vector<ne_real> inputs(count * input_size), outputs(count * output_size);
+        std::vector<float64> scores(count, 0.0);
+        
+        for(int a = 0; a < 2; ++a) {
+            for(int b = 0; b < 2; ++b) {
+                int c = a ^ b;
                 
-                inputs[0]->value = a;
-                inputs[1]->value = b;
+                for(uint64 k = 0; k != count; ++k) {
+                    inputs[k * 2] = a;
+                    inputs[k * 2 + 1] = b;
+                }
                 
-                gen->compute();
+                net.reset();
+                net.flush();
+                net.compute(inputs.data(), outputs.data());
                 
-                double d = outputs[0]->value - c;
-                fitness += 1.0 - d * d;
+                for(uint64 k = 0; k != count; ++k) {
+                    double d = outputs[k] - c;
+                    scores[k] += 1.0 - d * d;
+                }
             }
         }
         
-        fitness *= 0.25;
+        for(uint64 k = 0; k != count; ++k) {
+            genomes[k]->fitness = scores[k] * 0.25;
+        }
     }
 };
 
@@ -159,34 +404,181 @@ struct Count10 : public Obj
     
     void run(ne_genome* gen) {
         fitness = 0.0;
-        gen->flush();
+        
+        ne_phenotype& net = *gen->network(params.feed_forward != 0);
+        
+        net.reset();
+        net.flush();
+        
+        ne_real* inputs = net.inputs();
+        ne_real* outputs = net.outputs();
         
         for(int i = 0; i < 10; ++i) {
-            ne_node** inputs = gen->inputs();
-            ne_node** outputs = gen->outputs();
+            inputs[0] = 0.0;
             
-            inputs[0]->value = 0.0;
+            if(record != nullptr)
+                record->insert(record->end(), inputs, inputs + input_size);
             
-            gen->compute();
+            net.compute();
             
-            double d = outputs[0]->value - (i == 9 ? 1.0 : 0.0);
+            double d = outputs[0] - (i == 9 ? 1.0 : 0.0);
             fitness += 1.0 - d * d;
         }
         
         fitness *= 0.1;
     }
+    
+    void run(ne_genome* const* genomes, ne_rng*, uint64 count) {
+        ne_group net(genomes, count, params.feed_forward != 0);
+        
+        net.flush();
+        
+        std::vector<ne_real> inputs(count * input_size, 0.0), outputs(count * output_size);
+        std::vector<float64> scores(count, 0.0);
+        
+        for(int i = 0; i < 10; ++i) {
+            net.compute(inputs.data(), outputs.data());
+            
+            for(uint64 k = 0; k != count; ++k) {
+                double d = outputs[k] - (i == 9 ? 1.0 : 0.0);
+                scores[k] += 1.0 - d * d;
+            }
+        }
+        
+        for(uint64 k = 0; k != count; ++k) {
+            genomes[k]->fitness = scores[k] * 0.1;
+        }
+    }
 };
 
 typedef Count10 obj_type;
 
-std::vector<obj_type> objs(params.population);
+std::vector<obj_type> objs;
+
+/// Quantizes the champion, calibrated on the inputs its own run feeds it,
+/// reports both formats' error on those inputs and writes the int8 form
+/// to `path` if given, or the int16 form when int8 is over
+/// ne_quantized8_error_limit.
+void quantize(ne_genome* champion, const char* path) {
+    std::vector<float64> samples;
+    
+    ne_rng rng;
+    rng.seed(params.seed, 0);
+    
+    {
+        ne_stream_scope scope(&rng);
+        
+        objs[0].record = &samples;
+        objs[0].run(champion);
+        objs[0].record = nullptr;
+    }
+    
+    bool feed_forward = params.feed_forward != 0;
+    uint64 count = samples.size() / obj_type::input_size;
+    
+    ne_quantized8 q8(champion, samples.data(), count, feed_forward);
+    ne_quantized16 q16(champion, samples.data(), count, feed_forward);
+    
+    ne_quantization_report r8 = q8.report(champion, samples.data(), count);
+    ne_quantization_report r16 = q16.report(champion, samples.data(), count);
+    
+    std::cout << "Quantized int8: value bits " << q8.value_bits() << "  weight bits " << q8.weight_bits() << "  bytes " << q8.footprint() << "  max error " << r8.max_error << "  mean error " << r8.mean_error << std::endl;
+    std::cout << "Quantized int16: value bits " << q16.value_bits() << "  weight bits " << q16.weight_bits() << "  bytes " << q16.footprint() << "  max error " << r16.max_error << "  mean error " << r16.mean_error << std::endl;
+    
+    if(path != nullptr) {
+        std::vector<uint8> bytes;
+        
+        if(r8.max_error <= ne_quantized8_error_limit) {
+            q8.write(bytes);
+        } else {
+            std::cout << "int8 error is over " << ne_quantized8_error_limit << ", writing int16" << std::endl;
+            q16.write(bytes);
+        }
+        
+        std::ofstream out(path, std::ios::binary);
+        out.write((const char*) bytes.data(), bytes.size());
+    }
+}
+
+/// Writes the champion as standalone C++ to `path`.
+void generate(ne_genome* champion, const char* path) {
+    ne_codegen codegen(champion, params.feed_forward != 0);
+    
+    if(!codegen.valid()) {
+        std::cout << "Champion could not be generated" << std::endl;
+        return;
+    }
+    
+    std::ofstream out(path);
+    codegen.write(out, "champion");
+}
+
+/// Evolves params.islands populations in forked processes that pass their
+/// best genomes around every migration_interval generations.
+int islands() {
+    ne_islands driver(params, obj_type::input_size, obj_type::output_size, params.islands);
+    
+    driver.interval = params.migration_interval;
+    driver.migrants = params.migrants;
+    
+    bool ok = driver.run(gens, [](ne_population* population, uint64) {
+        std::vector<obj_type> local(population->workers());
+        
+        population->evaluate_groups([&local](ne_genome* const* genomes, ne_rng* streams, uint64 count, uint64 worker) {
+            local[worker].score(genomes, streams, count);
+        });
+    }, [](ne_population* population, uint64 island, const ne_genome* best) {
+        /// One write per line keeps the islands' lines whole.
+        std::ostringstream line;
+        line << "Island: " << island << "  generation: " << population->generation << "  fitness: " << best->fitness << "  gene count: " << best->gene_count() << "  species: " << population->species.size() << std::endl;
+        
+        std::cout << line.str() << std::flush;
+    });
+    
+    if(!ok) {
+        std::cout << "An island failed" << std::endl;
+        return 1;
+    }
+    
+    uint64 top = 0;
+    
+    for(uint64 k = 0; k != driver.size(); ++k) {
+        std::cout << "Island " << k << " champion fitness: " << driver.champions[k]->fitness << std::endl;
+        
+        if(driver.champions[k]->fitness > driver.champions[top]->fitness)
+            top = k;
+    }
+    
+    std::cout << "Champion: island " << top << "  fitness: " << driver.champions[top]->fitness << std::endl;
+    
+    return 0;
+}
+
+/// Evolves in steady state, reporting once per population's worth of births.
+int steady() {
+    for(int n = 0; n < gens; ++n) {
+        ne_genome* best = population.evolve(params.population, [](ne_genome* genome, uint64 worker) {
+            objs[worker].run(genome);
+            return objs[worker].fitness;
+        });
+        
+        std::cout << "Generation: " << population.generation << "  species: " << population.species.size() << "  fitness: " << best->fitness << "  gene count: " << best->gene_count() << "  node count: " << best->node_count() << std::endl;
+    }
+    
+    return 0;
+}
 
 void initialize(const char* file) {
     std::ifstream in;
     in.open(file);
     params.load(in);
+}
+
+/// Starts the population's workers, which islands() must not do before it
+/// forks.
+void populate() {
     population.reset(params, obj_type::input_size, obj_type::output_size);
-    objs.resize(params.population);
+    objs.resize(population.workers());
 }
 
 int main(int argc, const char * argv[]) {
@@ -196,20 +588,34 @@ int main(int argc, const char * argv[]) {
     }
     
     initialize(argv[1]);
-
+    
+    if(params.islands > 1)
+        return islands();
+    
+    populate();
+    
+    if(params.steady_state != 0)
+        return steady();
+    
+    const char* checkpoint = argc > 2 ? argv[2] : nullptr;
+    
+    if(checkpoint != nullptr && population.restore(checkpoint))
+        std::cout << "Resumed at generation " << population.generation << std::endl;
+    
     ne_genome* best = nullptr;
     
     std::vector<float64> highs;
-
-    for(int n = 0; n < gens; ++n) {
-        for(int i = 0; i < params.population; ++i) {
-            objs[i].run(population[i]);
-            
-            population[i]->fitness = objs[i].fitness;
-        }
+    
+    for(int n = (int) population.generation; n < gens; ++n) {
+        population.evaluate_groups([](ne_genome* const* genomes, ne_rng* streams, uint64 count, uint64 worker) {
+            objs[worker].score(genomes, streams, count);
+        });
         
         std::cout << "Generation: " << n << std::endl;
         
+        if(params.cache_fitness != 0)
+            std::cout << "Cache hits: " << population.cache_hits << " / " << population.cache_lookups << std::endl;
+        
         best = population.select();
         
         for(ne_species* sp : population.species) {
@@ -230,12 +636,42 @@ int main(int argc, const char * argv[]) {
         
         highs.push_back(best->fitness);
         
+        if(n == gens - 1) {
+            quantize(best, argc > 3 ? argv[3] : nullptr);
+            
+            if(argc > 4)
+                generate(best, argv[4]);
+        }
+        
         population.reproduce();
+        
+        if(checkpoint != nullptr)
+            population.checkpoint(checkpoint);
     }
     
+    population.sync();
+
+#if defined(NE_PROFILE)
+    for(const ne_profile_record& r : ne_profiler::instance().history()) {
+        std::cout << "Profile " << r.generation << ":";
+        
+        for(uint64 t = 0; t != ne_timer_count; ++t) {
+            std::cout << "  " << ne_profiler::timer_names()[t] << " " << r.time[t] * 1e3 << " ms";
+        }
+        
+        for(uint64 c = 0; c != ne_counter_count; ++c) {
+            std::cout << "  " << ne_profiler::counter_names()[c] << " " << r.counters[c];
+        }
+        
+        std::cout << "  genes " << r.genes << "  nodes " << r.nodes << "  activations " << r.activations << std::endl;
+    }
+    
+    ne_profiler::instance().write_trace("trace.json");
+#endif
+
     std::cout << "Highs: " << std::endl;
     
-    for(uint64 i = 0; i < gens; ++i) {
+    for(uint64 i = 0; i < highs.size(); ++i) {
         std::cout << i << "\t" << highs[i] << std::endl;
     }
     
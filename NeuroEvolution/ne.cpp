@@ -22,10 +22,19 @@ const std::string ne_params::names[] = {
     "weights_mutation_rate",
     "mutate_activation_prob",
     "mate_avg_prob",
+    "mutate_function_prob",
     
     "timeout",
     "population",
-    "dropoff_age"
+    "dropoff_age",
+    "threads",
+    "seed",
+    "feed_forward",
+    "cache_fitness",
+    "islands",
+    "migration_interval",
+    "migrants",
+    "steady_state"
 };
 
 const uint64 ne_params::n = sizeof(ne_params::names) / sizeof(*ne_params::names);
@@ -49,7 +58,7 @@ bool ne_params::load(std::ifstream& in) {
     while(true) {
         if(!(in >> name)) break;
         uint64 i = find_index(name);
-
+        
         if(i == -1) {
             std::cout << "Unknown name: " << name << std::endl;
             in >> name;
@@ -66,6 +75,6 @@ bool ne_params::load(std::ifstream& in) {
             (&begin_float)[i] = x;
         }
     }
-
+    
     return true;
 }
@@ -9,15 +9,16 @@
 #ifndef ne_h
 #define ne_h
 
-#include "common.h"
+#include "activation.h"
+#include "random.h"
+#include "profiler.h"
+#include "table.h"
 #include <unordered_set>
 #include <unordered_map>
 #include <fstream>
 #include <iostream>
 #include <vector>
 
-#define ne_function(x) (1.0 + x / (1.0 + fabs(x)))
-
 struct ne_params {
     union {
         float64 weights_power;
@@ -36,6 +37,7 @@ struct ne_params {
     float64 weights_mutation_rate;
     float64 mutate_activation_prob;
     float64 mate_avg_prob;
+    float64 mutate_function_prob;
     
     union {
         uint64 timeout;
@@ -44,6 +46,30 @@ struct ne_params {
     
     uint64 population;
     uint64 dropoff_age;
+    uint64 threads;
+    uint64 seed;
+    
+    /// Nonzero runs networks in one forward pass: mutate_add_gene refuses
+    /// genes that close a cycle and activations stay fixed. Crossover is
+    /// not checked and can still join two parents' genes into a cycle; a
+    /// cyclic genome falls back to the activation sweeps.
+    uint64 feed_forward;
+    
+    /// Nonzero declares the task deterministic, so that a genome's fitness
+    /// depends only on its network. A genome that computes exactly what one
+    /// scored in the same or the previous evaluation takes its fitness.
+    uint64 cache_fitness;
+    
+    /// Populations run side by side by ne_islands, the generations between
+    /// their migrations and the genomes each one sends. The demo runs one
+    /// population unless islands is above 1.
+    uint64 islands;
+    uint64 migration_interval;
+    uint64 migrants;
+    
+    /// Nonzero makes the demo evolve with ne_population::evolve instead of
+    /// generation by generation.
+    uint64 steady_state;
     
     static const std::string names[];
     
@@ -65,6 +91,7 @@ struct ne_node
     
     bool computed;
     bool activated;
+    uint8 function;
     uint64 id;
 };
 
@@ -99,6 +126,8 @@ struct ne_innovation
     
     float64 weight;
     
+    inline ne_innovation() {}
+    
     inline ne_innovation(ne_gene* gene, uint32 type) : i(gene->i->id), j(gene->j->id), type(type) {}
 };
 
@@ -111,17 +140,41 @@ inline size_t ne_hash(uint64 i, uint64 j) {
     return (((i + j) * (i + j + 1)) >> 1) + j;
 }
 
-struct ne_gene_hash
+struct ne_gene_key
 {
-    inline uint64 operator () (const ne_gene* x) const {
-        return ne_hash(x->i->id, x->j->id);
+    struct key_type
+    {
+        uint64 i;
+        uint64 j;
+    };
+    
+    static inline key_type key(const ne_gene* x) {
+        return { x->i->id, x->j->id };
+    }
+    
+    static inline uint64 hash(const key_type& k) {
+        return ne_mix(ne_hash(k.i, k.j));
+    }
+    
+    static inline bool equal(const ne_gene* x, const key_type& k) {
+        return x->i->id == k.i && x->j->id == k.j;
     }
 };
 
-struct ne_gene_equal
+struct ne_node_key
 {
-    inline bool operator () (const ne_gene* a, const ne_gene* b) const {
-        return a->i->id == b->i->id && a->j->id == b->j->id;
+    typedef uint64 key_type;
+    
+    static inline key_type key(const ne_node* x) {
+        return x->id;
+    }
+    
+    static inline uint64 hash(key_type id) {
+        return ne_mix(id);
+    }
+    
+    static inline bool equal(const ne_node* x, key_type id) {
+        return x->id == id;
     }
 };
 
@@ -140,24 +193,28 @@ struct ne_innovation_equal
         switch(a.type) {
             case ne_new_gene:
                 return a.i == b.i && a.j == b.j;
-                
+            
             case ne_new_node:
                 return a.innovation2 == a.innovation2 && a.i == b.i && a.j == b.j;
-                
+            
             default:
                 return false;
         }
     }
 };
 
-typedef std::unordered_set<ne_gene*, ne_gene_hash, ne_gene_equal> ne_gene_set;
+typedef ne_table<ne_gene, ne_gene_key> ne_gene_set;
 typedef std::unordered_set<ne_innovation, ne_innovation_hash, ne_innovation_equal> ne_innovation_set;
-typedef std::unordered_map<uint64, ne_node*> ne_nodes_map;
+typedef ne_table<ne_node, ne_node_key> ne_nodes_map;
 
 inline void ne_get_innovation(ne_innovation_set* set, uint64* innovation, uint64* nodes_id, ne_innovation* p) {
     ne_innovation_set::iterator it = set->find(*p);
-
+    
+    NE_COUNT(ne_counter_lookups, 1);
+    
     if(it != set->end()) {
+        NE_COUNT(ne_counter_hits, 1);
+        
         p->innovation1 = it->innovation1;
         p->id = it->id;
         p->weight = it->weight;
@@ -0,0 +1,684 @@
+//
+//  phenotype.cpp
+//  NeuroEvolution
+//
+
+#include "phenotype.h"
+#include <algorithm>
+
+template <class T>
+void ne_basic_phenotype<T>::compile(const ne_genome* genome, bool feed_forward) {
+    const std::vector<ne_node*>& nodes = genome->nodes;
+    uint64 size = nodes.size();
+    
+    input_size = genome->input_size;
+    output_size = genome->output_size;
+    bias_node = genome->bias_node;
+    activations = genome->activations;
+    
+    uint64 q = input_size + output_size;
+    
+    values.resize(size);
+    sums.resize(size);
+    activated.resize(size);
+    computed.resize(size);
+    
+    functions.resize(size);
+    runs.clear();
+    
+    index.resize(size);
+    
+    hidden_begin = size;
+    
+    for(uint64 i = 0; i != size; ++i) {
+        if(nodes[i]->id >= q) {
+            hidden_begin = i;
+            break;
+        }
+    }
+    
+    std::vector<uint64> ranking(size);
+    std::vector<uint32> slots(size);
+    
+    for(uint64 i = 0; i != size; ++i) {
+        ranking[i] = i;
+    }
+    
+    std::stable_sort(ranking.begin() + hidden_begin, ranking.end(), [&nodes](uint64 a, uint64 b) {
+        return nodes[a]->function < nodes[b]->function;
+    });
+    
+    for(uint64 k = 0; k != size; ++k) {
+        const ne_node* node = nodes[ranking[k]];
+        
+        slots[ranking[k]] = (uint32) k;
+        index[ranking[k]] = { node->id, (uint32) k };
+        
+        values[k] = node->value;
+        activated[k] = node->activated;
+        functions[k] = node->function;
+        
+        if(k >= hidden_begin) {
+            if(runs.empty() || runs.back().function != node->function)
+                runs.push_back({ node->function, k, k });
+            
+            ++runs.back().end;
+        }
+    }
+    
+    auto slot = [&nodes, &slots](const ne_node* node) {
+        return slots[std::lower_bound(nodes.begin(), nodes.end(), node->id, [](const ne_node* a, uint64 id) {
+            return a->id < id;
+        }) - nodes.begin()];
+    };
+    
+    std::vector<uint64> offsets(size + 1, 0);
+    
+    for(const ne_gene* gene : genome->genes) {
+        if(gene->weight != 0.0)
+            ++offsets[slot(gene->j) + 1];
+    }
+    
+    for(uint64 i = 0; i != size; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    
+    edges = offsets[size];
+    tail = edges;
+    garbage = 0;
+    
+    ranges.resize(size);
+    sources.resize(_room(edges));
+    innovations.resize(_room(edges));
+    weights.resize(_room(edges));
+    
+    for(uint64 i = 0; i != size; ++i) {
+        ranges[i] = { offsets[i], offsets[i], offsets[i + 1] };
+    }
+    
+    for(const ne_gene* gene : genome->genes) {
+        if(gene->weight != 0.0) {
+            uint64 e = ranges[slot(gene->j)].end++;
+            sources[e] = slot(gene->i);
+            innovations[e] = gene->innovation;
+            weights[e] = gene->weight;
+        }
+    }
+    
+    sorted = feed_forward;
+    forward = false;
+    order.clear();
+    positions.clear();
+    
+    if(feed_forward)
+        _sort();
+}
+
+/// Kahn's algorithm over every slot. Slots without edges stay in the order
+/// so that update() can place new edges relative to them; compute() skips
+/// them.
+template <class T>
+void ne_basic_phenotype<T>::_sort() {
+    uint64 size = values.size();
+    
+    std::vector<uint64> degree(size), heads(size + 1, 0);
+    std::vector<uint32> targets(edges);
+    
+    for(uint64 j = 0; j != size; ++j) {
+        for(uint64 e = ranges[j].begin; e != ranges[j].end; ++e) {
+            ++heads[sources[e] + 1];
+        }
+        
+        degree[j] = ranges[j].end - ranges[j].begin;
+    }
+    
+    for(uint64 i = 0; i != size; ++i) {
+        heads[i + 1] += heads[i];
+    }
+    
+    std::vector<uint64> out(heads.begin(), heads.end() - 1);
+    
+    for(uint64 j = 0; j != size; ++j) {
+        for(uint64 e = ranges[j].begin; e != ranges[j].end; ++e) {
+            targets[out[sources[e]]++] = (uint32) j;
+        }
+        
+        if(degree[j] == 0)
+            order.push_back((uint32) j);
+    }
+    
+    for(uint64 k = 0; k != order.size(); ++k) {
+        uint32 i = order[k];
+        
+        for(uint64 e = heads[i]; e != heads[i + 1]; ++e) {
+            if(--degree[targets[e]] == 0)
+                order.push_back(targets[e]);
+        }
+    }
+    
+    forward = order.size() == size;
+    
+    if(!forward) {
+        order.clear();
+        return;
+    }
+    
+    positions.resize(size);
+    
+    for(uint64 k = 0; k != size; ++k) {
+        positions[order[k]] = (uint32) k;
+    }
+}
+
+/// The edge arrays keep room past the tail, which copies inherit, so the
+/// first slots a copy moves do not reallocate every edge.
+template <class T>
+uint64 ne_basic_phenotype<T>::_room(uint64 n) {
+    return n + n / 4 + 16;
+}
+
+template <class T>
+uint32 ne_basic_phenotype<T>::_slot(uint64 id) const {
+    return std::lower_bound(index.begin(), index.end(), id, [](const ne_slot& a, uint64 id) {
+        return a.id < id;
+    })->slot;
+}
+
+template <class T>
+uint64 ne_basic_phenotype<T>::_find(uint32 j, uint64 innovation) const {
+    return std::lower_bound(innovations.begin() + ranges[j].begin, innovations.begin() + ranges[j].end, innovation) - innovations.begin();
+}
+
+template <class T>
+void ne_basic_phenotype<T>::update(const ne_gene* gene) {
+    uint32 j = _slot(gene->j->id);
+    uint64 e = _find(j, gene->innovation);
+    
+    bool found = e != ranges[j].end && innovations[e] == gene->innovation;
+    
+    if(gene->weight == 0.0) {
+        if(found) {
+            uint64 end = --ranges[j].end;
+            
+            std::move(sources.begin() + e + 1, sources.begin() + end + 1, sources.begin() + e);
+            std::move(innovations.begin() + e + 1, innovations.begin() + end + 1, innovations.begin() + e);
+            std::move(weights.begin() + e + 1, weights.begin() + end + 1, weights.begin() + e);
+            
+            --edges;
+        }
+        
+        return;
+    }
+    
+    if(found) {
+        weights[e] = gene->weight;
+        return;
+    }
+    
+    if(ranges[j].end == ranges[j].limit) {
+        _grow(j);
+        e = _find(j, gene->innovation);
+    }
+    
+    uint64 end = ranges[j].end++;
+    
+    std::move_backward(sources.begin() + e, sources.begin() + end, sources.begin() + end + 1);
+    std::move_backward(innovations.begin() + e, innovations.begin() + end, innovations.begin() + end + 1);
+    std::move_backward(weights.begin() + e, weights.begin() + end, weights.begin() + end + 1);
+    
+    uint32 i = _slot(gene->i->id);
+    
+    sources[e] = i;
+    innovations[e] = gene->innovation;
+    weights[e] = gene->weight;
+    
+    ++edges;
+    
+    if(forward && positions[i] >= positions[j])
+        _reorder(i, j);
+}
+
+/// Moves a full slot to the end of the edge arrays with twice the room.
+/// The space it leaves behind is reclaimed by _compact() once there is
+/// more of it than there are edges.
+template <class T>
+void ne_basic_phenotype<T>::_grow(uint32 j) {
+    if(garbage > edges)
+        _compact();
+    
+    ne_range& range = ranges[j];
+    
+    uint64 n = range.end - range.begin;
+    uint64 begin = tail;
+    uint64 limit = begin + std::max<uint64>(4, n * 2);
+    
+    if(limit > sources.size()) {
+        uint64 room = std::max(limit, 2 * sources.size());
+        
+        sources.resize(room);
+        innovations.resize(room);
+        weights.resize(room);
+    }
+    
+    std::copy(sources.begin() + range.begin, sources.begin() + range.end, sources.begin() + begin);
+    std::copy(innovations.begin() + range.begin, innovations.begin() + range.end, innovations.begin() + begin);
+    std::copy(weights.begin() + range.begin, weights.begin() + range.end, weights.begin() + begin);
+    
+    garbage += range.limit - range.begin;
+    tail = limit;
+    
+    range = { begin, begin + n, limit };
+}
+
+template <class T>
+void ne_basic_phenotype<T>::_compact() {
+    std::vector<uint32> s(_room(edges));
+    std::vector<uint64> v(_room(edges));
+    std::vector<T> w(_room(edges));
+    
+    uint64 c = 0;
+    
+    for(ne_range& range : ranges) {
+        uint64 n = range.end - range.begin;
+        
+        std::copy(sources.begin() + range.begin, sources.begin() + range.end, s.begin() + c);
+        std::copy(innovations.begin() + range.begin, innovations.begin() + range.end, v.begin() + c);
+        std::copy(weights.begin() + range.begin, weights.begin() + range.end, w.begin() + c);
+        
+        range = { c, c + n, c + n };
+        c += n;
+    }
+    
+    sources.swap(s);
+    innovations.swap(v);
+    weights.swap(w);
+    
+    tail = c;
+    garbage = 0;
+}
+
+/// Restores the topological order after a new edge i -> j with j not
+/// after i. Only the part of the order from j to i moves: the ancestors of
+/// i found there go first, everything else keeps its place behind them,
+/// and both groups keep their relative order. If j is among the ancestors
+/// the edge closed a cycle and the network falls back to sweeps.
+template <class T>
+void ne_basic_phenotype<T>::_reorder(uint32 i, uint32 j) {
+    uint64 lo = positions[j], hi = positions[i];
+    
+    std::vector<uint32> stack(1, i), region;
+    
+    /// computed is only used inside compute(), so it serves as the marks.
+    for(uint64 k = lo; k <= hi; ++k) {
+        computed[order[k]] = 0;
+    }
+    
+    computed[i] = 1;
+    
+    bool cyclic = i == j;
+    
+    while(!stack.empty() && !cyclic) {
+        uint32 u = stack.back();
+        stack.pop_back();
+        
+        for(uint64 e = ranges[u].begin; e != ranges[u].end; ++e) {
+            uint32 s = sources[e];
+            
+            if(positions[s] < lo || computed[s]) continue;
+            
+            if(s == j) {
+                cyclic = true;
+                break;
+            }
+            
+            computed[s] = 1;
+            stack.push_back(s);
+        }
+    }
+    
+    if(cyclic) {
+        forward = false;
+        order.clear();
+        positions.clear();
+        return;
+    }
+    
+    for(uint64 k = lo; k <= hi; ++k) {
+        if(computed[order[k]])
+            region.push_back(order[k]);
+    }
+    
+    for(uint64 k = lo; k <= hi; ++k) {
+        if(!computed[order[k]])
+            region.push_back(order[k]);
+    }
+    
+    for(uint64 k = 0; k != region.size(); ++k) {
+        order[lo + k] = region[k];
+        positions[region[k]] = (uint32) (lo + k);
+    }
+}
+
+template <class T>
+void ne_basic_phenotype<T>::insert(const ne_node* node) {
+    uint32 k = (uint32) values.size();
+    uint64 end = tail;
+    
+    values.push_back(node->value);
+    sums.push_back(0.0);
+    activated.push_back(node->activated);
+    computed.push_back(0);
+    functions.push_back(node->function);
+    
+    ranges.push_back({ end, end, end });
+    
+    ne_slot entry = { node->id, k };
+    
+    index.insert(std::upper_bound(index.begin(), index.end(), entry, [](const ne_slot& a, const ne_slot& b) {
+        return a.id < b.id;
+    }), entry);
+    
+    if(!runs.empty() && runs.back().function == node->function)
+        ++runs.back().end;
+    else
+        runs.push_back({ node->function, k, k + 1 });
+    
+    if(forward) {
+        positions.push_back((uint32) order.size());
+        order.push_back(k);
+    }
+}
+
+template <class T>
+void ne_basic_phenotype<T>::update(const ne_node* node) {
+    uint32 k = _slot(node->id);
+    
+    if(k < hidden_begin || functions[k] == node->function)
+        return;
+    
+    functions[k] = node->function;
+    
+    uint64 r = std::upper_bound(runs.begin(), runs.end(), k, [](uint64 k, const ne_run& run) {
+        return k < run.begin;
+    }) - runs.begin() - 1;
+    
+    ne_run run = runs[r];
+    std::vector<ne_run> parts;
+    
+    if(run.begin != k)
+        parts.push_back({ run.function, run.begin, k });
+    
+    parts.push_back({ node->function, k, (uint64) k + 1 });
+    
+    if(k + 1 != run.end)
+        parts.push_back({ run.function, k + 1, run.end });
+    
+    runs.erase(runs.begin() + r);
+    runs.insert(runs.begin() + r, parts.begin(), parts.end());
+    
+    uint64 last = std::min<uint64>(r + parts.size(), runs.size() - 1);
+    
+    for(uint64 p = last; p != 0 && p >= r; --p) {
+        if(runs[p - 1].function == runs[p].function) {
+            runs[p - 1].end = runs[p].end;
+            runs.erase(runs.begin() + p);
+        }
+    }
+}
+
+template <class T>
+void ne_basic_phenotype<T>::remap(uint64 base, const std::vector<uint64>& innovation_map, const std::vector<uint64>& node_map) {
+    bool changed = false;
+    
+    for(ne_slot& entry : index) {
+        if(entry.id >= base) {
+            entry.id = node_map[entry.id - base];
+            changed = true;
+        }
+    }
+    
+    if(changed) {
+        std::sort(index.begin(), index.end(), [](const ne_slot& a, const ne_slot& b) {
+            return a.id < b.id;
+        });
+    }
+    
+    for(const ne_range& range : ranges) {
+        changed = false;
+        
+        for(uint64 e = range.begin; e != range.end; ++e) {
+            if(innovations[e] >= base) {
+                innovations[e] = innovation_map[innovations[e] - base];
+                changed = true;
+            }
+        }
+        
+        if(!changed) continue;
+        
+        for(uint64 e = range.begin + 1; e < range.end; ++e) {
+            uint32 s = sources[e];
+            uint64 v = innovations[e];
+            T w = weights[e];
+            
+            uint64 k = e;
+            
+            for(; k != range.begin && innovations[k - 1] > v; --k) {
+                sources[k] = sources[k - 1];
+                innovations[k] = innovations[k - 1];
+                weights[k] = weights[k - 1];
+            }
+            
+            sources[k] = s;
+            innovations[k] = v;
+            weights[k] = w;
+        }
+    }
+}
+
+template <class T>
+void ne_basic_phenotype<T>::reset() {
+    std::fill(values.begin(), values.end(), 0.0);
+    std::fill(activated.begin(), activated.end(), 0);
+}
+
+template <class T>
+void ne_basic_phenotype<T>::flush() {
+    uint64 size = values.size();
+    
+    for(uint64 i = 0; i != size; ++i) {
+        activated[i] = i < input_size;
+    }
+    
+    values[bias_node] = 1.0;
+}
+
+template <class T>
+void ne_basic_phenotype<T>::compute() {
+    uint64 size = values.size(), n = 0;
+    
+    const ne_range* range = ranges.data();
+    const uint32* source = sources.data();
+    const T* weight = weights.data();
+    
+    T* value = values.data();
+    T* sum = sums.data();
+    uint8* active = activated.data();
+    uint8* next = computed.data();
+    
+    if(forward) {
+        for(uint32 j : order) {
+            if(range[j].begin == range[j].end) continue;
+            
+            T s = 0.0;
+            uint8 c = 0;
+            
+            for(uint64 e = range[j].begin; e != range[j].end; ++e) {
+                if(active[source[e]]) {
+                    c = 1;
+                    s += value[source[e]] * weight[e];
+                }
+            }
+            
+            if(c)
+                value[j] = j >= hidden_begin ? ne_activate(functions[j], s) : s;
+            
+            active[j] = c;
+        }
+        
+        return;
+    }
+    
+    while(n != activations) {
+        for(uint64 j = 0; j != size; ++j) {
+            T s = 0.0;
+            uint8 c = 0;
+            
+            for(uint64 e = range[j].begin; e != range[j].end; ++e) {
+                if(active[source[e]]) {
+                    c = 1;
+                    s += value[source[e]] * weight[e];
+                }
+            }
+            
+            sum[j] = s;
+            next[j] = c;
+        }
+        
+        for(const ne_run& run : runs) {
+            ne_activate(run.function, sum + run.begin, run.end - run.begin);
+        }
+        
+        for(uint64 j = 0; j != size; ++j) {
+            if(next[j])
+                value[j] = sum[j];
+            
+            active[j] = next[j];
+        }
+        
+        ++n;
+    }
+}
+
+template <class T>
+void ne_basic_phenotype<T>::compute(const T* inputs, T* outputs, uint64 batch) {
+    uint64 inputs_size = input_size - 1;
+    
+    for(uint64 k = 0; k < batch; k += ne_batch_block) {
+        uint64 lanes = std::min(batch - k, ne_batch_block);
+        _compute(inputs + k * inputs_size, outputs + k * output_size, lanes);
+    }
+}
+
+template <class T>
+void ne_basic_phenotype<T>::_compute(const T* inputs, T* outputs, uint64 lanes) {
+    uint64 size = values.size(), n = 0;
+    uint64 inputs_size = input_size - 1;
+    
+    scratch.values.resize(size * lanes);
+    scratch.sums.resize(size * lanes);
+    scratch.activated.resize(size * lanes);
+    scratch.computed.resize(size * lanes);
+    
+    const ne_range* range = ranges.data();
+    const uint32* source = sources.data();
+    const T* weight = weights.data();
+    
+    T* value = scratch.values.data();
+    T* sum = scratch.sums.data();
+    uint8* active = scratch.activated.data();
+    uint8* next = scratch.computed.data();
+    
+    for(uint64 j = 0; j != size; ++j) {
+        std::fill(value + j * lanes, value + (j + 1) * lanes, values[j]);
+        std::fill(active + j * lanes, active + (j + 1) * lanes, j < input_size);
+    }
+    
+    for(uint64 i = 0; i != inputs_size; ++i) {
+        for(uint64 l = 0; l != lanes; ++l) {
+            value[i * lanes + l] = inputs[l * inputs_size + i];
+        }
+    }
+    
+    std::fill(value + bias_node * lanes, value + (bias_node + 1) * lanes, 1.0);
+    
+    if(forward) {
+        for(uint32 j : order) {
+            if(range[j].begin == range[j].end) continue;
+            
+            T* v = value + j * lanes;
+            T* s = sum + j * lanes;
+            uint8* c = active + j * lanes;
+            
+            std::fill(s, s + lanes, 0.0);
+            std::fill(next, next + lanes, 0);
+            
+            for(uint64 e = range[j].begin; e != range[j].end; ++e) {
+                const T* u = value + source[e] * lanes;
+                const uint8* a = active + source[e] * lanes;
+                T w = weight[e];
+                
+                for(uint64 l = 0; l != lanes; ++l) {
+                    next[l] |= a[l];
+                    s[l] += a[l] ? u[l] * w : T(0);
+                }
+            }
+            
+            if(j >= hidden_begin)
+                ne_activate(functions[j], s, lanes);
+            
+            for(uint64 l = 0; l != lanes; ++l) {
+                v[l] = next[l] ? s[l] : v[l];
+                c[l] = next[l];
+            }
+        }
+        
+        n = activations;
+    }
+    
+    while(n != activations) {
+        for(uint64 j = 0; j != size; ++j) {
+            T* s = sum + j * lanes;
+            uint8* c = next + j * lanes;
+            
+            std::fill(s, s + lanes, 0.0);
+            std::fill(c, c + lanes, 0);
+            
+            for(uint64 e = range[j].begin; e != range[j].end; ++e) {
+                const T* v = value + source[e] * lanes;
+                const uint8* a = active + source[e] * lanes;
+                T w = weight[e];
+                
+                for(uint64 l = 0; l != lanes; ++l) {
+                    c[l] |= a[l];
+                    s[l] += a[l] ? v[l] * w : T(0);
+                }
+            }
+        }
+        
+        for(uint64 j = 0; j != size; ++j) {
+            T* v = value + j * lanes;
+            T* s = sum + j * lanes;
+            const uint8* c = next + j * lanes;
+            
+            if(j >= hidden_begin)
+                ne_activate(functions[j], s, lanes);
+            
+            for(uint64 l = 0; l != lanes; ++l) {
+                v[l] = c[l] ? s[l] : v[l];
+            }
+        }
+        
+        std::swap(active, next);
+        
+        ++n;
+    }
+    
+    for(uint64 i = 0; i != output_size; ++i) {
+        for(uint64 l = 0; l != lanes; ++l) {
+            outputs[l * output_size + i] = value[(input_size + i) * lanes + l];
+        }
+    }
+}
+
+template class ne_basic_phenotype<float32>;
+template class ne_basic_phenotype<float64>;
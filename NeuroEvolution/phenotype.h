@@ -0,0 +1,214 @@
+//
+//  phenotype.h
+//  NeuroEvolution
+//
+
+#ifndef ne_phenotype_h
+#define ne_phenotype_h
+
+#include "genome.h"
+
+const uint64 ne_batch_block = 256;
+
+/// A read-only network compiled from a genome. Nodes are dense slots, with
+/// inputs and outputs first in the genome's order and hidden nodes grouped
+/// by activation function so each group is one vector kernel call. The
+/// enabled genes are stored as a CSR list of incoming edges per slot, kept
+/// in innovation order so every sum is accumulated exactly as
+/// ne_genome::compute does it.
+///
+/// A compiled network can follow its genome through mutations without
+/// being rebuilt. Each slot's edges sit in a range with room to grow, and
+/// a slot that outgrows its range moves to the end of the edge arrays, so
+/// an update costs time in the size of the mutation, not of the genome.
+///
+/// Values, sums and weights are of type T, float64 or float32. A float64
+/// network computes bit for bit what its genome does; a float32 one rounds
+/// the weights and every sum to single precision, which doubles the width
+/// of each vector operation for inference. ne_phenotype is the precision
+/// ne_real selects.
+template <class T>
+class ne_basic_phenotype
+{
+    
+public:
+    
+    ne_basic_phenotype() {}
+    
+    ne_basic_phenotype(const ne_genome* genome, bool feed_forward = false) {
+        compile(genome, feed_forward);
+    }
+    
+    inline T* inputs() {
+        return values.data();
+    }
+    
+    inline T* outputs() {
+        return values.data() + input_size;
+    }
+    
+    inline uint64 node_count() const {
+        return values.size();
+    }
+    
+    inline uint64 edge_count() const {
+        return edges;
+    }
+    
+    inline uint64 input_count() const {
+        return input_size - 1;
+    }
+    
+    inline uint64 output_count() const {
+        return output_size;
+    }
+    
+    /// With `feed_forward` set and an acyclic genome, compute() makes one
+    /// pass in topological order, as ne_genome::compute_forward does,
+    /// instead of `activations` sweeps.
+    void compile(const ne_genome* genome, bool feed_forward = false);
+    
+    inline bool single_pass() const {
+        return forward;
+    }
+    
+    /// Whether compile() was asked for the single pass.
+    inline bool feed_forward() const {
+        return sorted;
+    }
+    
+    /// Adds, reweights or removes the edge of `gene` so it matches the gene;
+    /// a disabled gene has no edge. Both nodes must already have slots. In
+    /// single-pass mode only the part of the order between the gene's two
+    /// ends is rearranged.
+    void update(const ne_gene* gene);
+    
+    /// Adds a slot for a new hidden node.
+    void insert(const ne_node* node);
+    
+    /// Follows a change of a hidden node's activation function.
+    void update(const ne_node* node);
+    
+    /// Renumbers node ids and innovations as ne_genome::remap does.
+    void remap(uint64 base, const std::vector<uint64>& innovation_map, const std::vector<uint64>& node_map);
+    
+    /// Zeroes every value and activation, the state compile() gives a
+    /// genome that has never been computed.
+    void reset();
+    
+    void flush();
+    
+    void compute();
+    
+    /// Runs `batch` samples at once. Every sample starts from the current
+    /// state as if flush() was called on its own copy of the network, then
+    /// reads `input_count()` values from its row of `inputs` and writes
+    /// `output_count()` values to its row of `outputs`.
+    void compute(const T* inputs, T* outputs, uint64 batch);
+    
+    uint64 activations;
+    
+private:
+    
+    template <class U>
+    friend class ne_basic_group;
+    
+    template <class W>
+    friend class ne_basic_quantized;
+    
+    friend class ne_codegen;
+    
+    struct ne_run
+    {
+        uint8 function;
+        uint64 begin;
+        uint64 end;
+    };
+    
+    /// The edges of one slot are [begin, end) and it may grow up to limit.
+    struct ne_range
+    {
+        uint64 begin;
+        uint64 end;
+        uint64 limit;
+    };
+    
+    struct ne_slot
+    {
+        uint64 id;
+        uint32 slot;
+    };
+    
+    /// Scratch for batches, which a copy of the network does not inherit.
+    struct ne_lanes
+    {
+        std::vector<T> values;
+        std::vector<T> sums;
+        
+        std::vector<uint8> activated;
+        std::vector<uint8> computed;
+        
+        ne_lanes() {}
+        
+        ne_lanes(const ne_lanes&) {}
+        
+        ne_lanes& operator = (const ne_lanes&) {
+            return *this;
+        }
+    };
+    
+    uint64 bias_node;
+    uint64 hidden_begin;
+    
+    uint64 input_size;
+    uint64 output_size;
+    
+    void _compute(const T* inputs, T* outputs, uint64 lanes);
+    
+    void _sort();
+    
+    uint32 _slot(uint64 id) const;
+    
+    uint64 _find(uint32 j, uint64 innovation) const;
+    
+    static uint64 _room(uint64 n);
+    
+    void _grow(uint32 j);
+    
+    void _compact();
+    
+    void _reorder(uint32 i, uint32 j);
+    
+    bool sorted = false;
+    bool forward = false;
+    
+    std::vector<uint32> order;
+    std::vector<uint32> positions;
+    
+    std::vector<ne_slot> index;
+    
+    std::vector<T> values;
+    std::vector<T> sums;
+    
+    std::vector<uint8> activated;
+    std::vector<uint8> computed;
+    
+    std::vector<uint8> functions;
+    std::vector<ne_run> runs;
+    
+    ne_lanes scratch;
+    
+    uint64 edges;
+    uint64 tail;
+    uint64 garbage;
+    
+    std::vector<ne_range> ranges;
+    std::vector<uint32> sources;
+    std::vector<uint64> innovations;
+    std::vector<T> weights;
+};
+
+typedef ne_basic_phenotype<float32> ne_phenotype32;
+typedef ne_basic_phenotype<float64> ne_phenotype64;
+
+#endif /* ne_phenotype_h */
@@ -7,12 +7,86 @@
 //
 
 #include "population.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+
+static const uint64 ne_local = (uint64) 1 << 48;
+
+/// Every random draw the population makes runs under a stream derived
+/// from params.seed, the generation and the phase, numbered by genome or
+/// baby, so results do not depend on the thread count.
+enum ne_phase
+{
+    ne_phase_reset = 0,
+    ne_phase_evaluate,
+    ne_phase_breed,
+    ne_phase_count
+};
+
+static inline uint64 ne_phase_seed(uint64 seed, uint64 generation, uint64 phase) {
+    return ne_mix(seed + ne_mix(generation * ne_phase_count + phase));
+}
+
+/// "NEMG"
+static const uint64 ne_migration_magic = 0x474d454e;
+
+static const uint64 ne_unmapped = (uint64) -1;
+
+/// The species of a candidate no species is close enough to.
+static const uint64 ne_no_species = (uint64) -1;
+
+/// "NEPC"
+static const uint64 ne_checkpoint_magic = 0x4350454e;
+static const uint64 ne_checkpoint_version = 1;
+
+static inline void ne_put(std::vector<uint8>& out, uint64 x) {
+    x = ne_little(x);
+    
+    uint64 size = out.size();
+    out.resize(size + sizeof(x));
+    memcpy(out.data() + size, &x, sizeof(x));
+}
+
+struct ne_reader
+{
+    const uint8* data;
+    const uint8* end;
+    
+    bool good;
+    
+    inline uint64 get() {
+        uint64 x = 0;
+        
+        if(good && (uint64) (end - data) >= sizeof(x)) {
+            memcpy(&x, data, sizeof(x));
+            data += sizeof(x);
+        }else{
+            good = false;
+        }
+        
+        return ne_little(x);
+    }
+    
+    /// Reads a count and checks that at least `words` words per item remain.
+    inline uint64 count(uint64 words) {
+        uint64 n = get();
+        
+        if(n > (uint64) (end - data) / (words * sizeof(uint64)))
+            good = false;
+        
+        return good ? n : 0;
+    }
+};
 
 ne_population& ne_population::operator = (const ne_population& population) {
     params = population.params;
     
     _kill();
     
+    pool.reset(params.threads);
+    
     genomes.resize(params.population);
     
     for(uint64 i = 0; i < params.population; ++i) {
@@ -21,6 +95,8 @@ ne_population& ne_population::operator = (const ne_population& population) {
     
     innovation = population.innovation;
     node_ids = population.node_ids;
+    generation = population.generation;
+    steady = false;
     
     _speciate();
     
@@ -32,10 +108,23 @@ void ne_population::reset(const ne_params& _params, uint64 input_size, uint64 ou
     
     _kill();
     
+    pool.reset(params.threads);
+    
     genomes.resize(params.population);
     
     innovation = 0;
+    generation = 0;
     set.clear();
+    cache.clear();
+    foreign.clear();
+    steady = false;
+    
+    if(params.seed == 0)
+        params.seed = rand64();
+    
+    ne_rng rng;
+    rng.seed(ne_phase_seed(params.seed, 0, ne_phase_reset));
+    ne_stream_scope scope(&rng);
     
     for(ne_genome*& genome : genomes) {
         genome = new ne_genome();
@@ -47,41 +136,300 @@ void ne_population::reset(const ne_params& _params, uint64 input_size, uint64 ou
     _speciate();
 }
 
-ne_genome* ne_population::_breed(ne_species *sp) {
-    ne_genome* baby;
+ne_genome* ne_population::_spawn() {
+    if(recycled.empty())
+        return new ne_genome();
     
+    ne_genome* genome = recycled.back();
+    recycled.pop_back();
+    return genome;
+}
+
+void ne_population::_breed(ne_species *sp, ne_genome* baby, ne_log* log) {
+    const ne_genome* a;
+    const ne_genome* b;
+    
+    _choose(sp, &a, &b);
+    _make(a, b, baby, log);
+}
+
+void ne_population::_choose(ne_species* sp, const ne_genome** a, const ne_genome** b) {
     uint64 i1 = random(0, sp->parents);
     
-    if(random(0.0, 1.0) < params.mutate_only_prob || sp->parents == 1) {
-        baby = new ne_genome(*sp->genomes[i1]);
+    *a = sp->genomes[i1];
+    *b = nullptr;
+    
+    if(random(0.0, 1.0) < params.mutate_only_prob || sp->parents == 1)
+        return;
+    
+    if(random(0.0, 1.0) < params.interspecies_mate_prob) {
+        uint64 i2 = random(0, species.size());
         
-        ne_mutate(baby, &set, &innovation, &node_ids, params);
+        /// evolve() leaves emptied species in place for a while.
+        *b = species[i2]->genomes.empty() ? *a : species[i2]->genomes[0];
     }else{
-        if(random(0.0, 1.0) < params.interspecies_mate_prob) {
-            uint64 i2 = random(0, species.size());
-            baby = ne_genome::crossover(sp->genomes[i1], species[i2]->genomes[0], params);
-        }else{
-            uint64 i2 = random(0, sp->parents);
-            baby = ne_genome::crossover(sp->genomes[i1], sp->genomes[i2], params);
-        }
+        uint64 i2 = random(0, sp->parents);
+        *b = sp->genomes[i2];
+    }
+}
+
+void ne_population::_make(const ne_genome* a, const ne_genome* b, ne_genome* baby, ne_log* log) {
+    log->set.clear();
+    log->innovation = ne_local;
+    log->node_ids = ne_local;
+    
+    if(b == nullptr) {
+        *baby = *a;
+        
+        ne_mutate(baby, &log->set, &log->innovation, &log->node_ids, params);
+    }else{
+        ne_genome::crossover(a, b, baby, params);
         
         if(random(0.0, 1.0) >= params.mate_only_prob) {
-            ne_mutate(baby, &set, &innovation, &node_ids, params);
+            ne_mutate(baby, &log->set, &log->innovation, &log->node_ids, params);
         }
     }
     
     baby->eliminated = false;
+}
+
+void ne_population::_register(ne_log* log) {
+    std::vector<const ne_innovation*> entries;
+    
+    for(const ne_innovation& p : log->set) {
+        entries.push_back(&p);
+    }
+    
+    std::sort(entries.begin(), entries.end(), [](const ne_innovation* a, const ne_innovation* b) {
+        return a->innovation1 < b->innovation1;
+    });
     
-    return baby;
+    log->innovation_map.resize(log->innovation - ne_local);
+    log->node_map.resize(log->node_ids - ne_local);
+    
+    auto node = [log](uint64 id) {
+        return id >= ne_local ? log->node_map[id - ne_local] : id;
+    };
+    
+    for(const ne_innovation* p : entries) {
+        ne_innovation q = *p;
+        
+        q.i = node(q.i);
+        q.j = node(q.j);
+        
+        if(q.type == ne_new_node && q.innovation2 >= ne_local)
+            q.innovation2 = log->innovation_map[q.innovation2 - ne_local];
+        
+        ne_innovation_set::iterator it = set.find(q);
+        
+        NE_COUNT(ne_counter_lookups, 1);
+        
+        if(it != set.end()) {
+            NE_COUNT(ne_counter_hits, 1);
+            
+            q.innovation1 = it->innovation1;
+            q.id = it->id;
+        }else{
+            q.innovation1 = innovation;
+            
+            if(q.type == ne_new_node) {
+                q.id = node_ids++;
+                innovation += 2;
+            }else{
+                innovation += 1;
+            }
+            
+            set.insert(q);
+        }
+        
+        log->innovation_map[p->innovation1 - ne_local] = q.innovation1;
+        
+        if(p->type == ne_new_node) {
+            log->innovation_map[p->innovation1 + 1 - ne_local] = q.innovation1 + 1;
+            log->node_map[p->id - ne_local] = q.id;
+        }
+    }
+}
+
+void ne_population::_resolve(ne_genome* baby, const ne_log* log) {
+    for(const ne_innovation& p : log->set) {
+        if(p.type == ne_new_node && baby->nodes_map.find(log->node_map[p.id - ne_local]) != nullptr)
+            baby->_unsplit(p.id, p.innovation2);
+    }
+}
+
+void ne_population::evaluate(const std::function<float64 (ne_genome* genome, uint64 worker)>& fitness) {
+    NE_PROFILE_SCOPE(ne_timer_evaluate);
+    
+    uint64 seed = ne_phase_seed(params.seed, generation, ne_phase_evaluate);
+    
+    _lookup();
+    
+    pool.run(pending.size(), [this, &fitness, seed](uint64 p, uint64 worker) {
+        uint64 i = pending[p];
+        
+        ne_rng rng;
+        rng.seed(seed, i);
+        ne_stream_scope scope(&rng);
+        
+        genomes[i]->fitness = fitness(genomes[i], worker);
+    });
+    
+    _store();
+}
+
+void ne_population::evaluate_groups(const std::function<void (ne_genome* const* genomes, ne_rng* streams, uint64 count, uint64 worker)>& fitness, uint64 lanes) {
+    NE_PROFILE_SCOPE(ne_timer_evaluate);
+    
+    uint64 seed = ne_phase_seed(params.seed, generation, ne_phase_evaluate);
+    
+    _lookup();
+    
+    uint64 size = pending.size();
+    
+    std::vector<uint64> hashes(genomes.size()), order(pending);
+    
+    pool.run(size, [this, &hashes](uint64 p, uint64) {
+        hashes[pending[p]] = genomes[pending[p]]->topology();
+    });
+    
+    std::sort(order.begin(), order.end(), [&hashes](uint64 a, uint64 b) {
+        return hashes[a] != hashes[b] ? hashes[a] < hashes[b] : a < b;
+    });
+    
+    std::vector<ne_genome*> members(size);
+    std::vector<ne_rng> streams(size);
+    std::vector<uint64> offsets(1, 0), rest, other;
+    
+    uint64 k = 0;
+    
+    for(uint64 b = 0, e; b != size; b = e) {
+        for(e = b; e != size && hashes[order[e]] == hashes[order[b]]; ++e);
+        
+        rest.assign(order.begin() + b, order.begin() + e);
+        
+        /// A hash collision only splits the run into more groups.
+        while(!rest.empty()) {
+            const ne_genome* first = genomes[rest[0]];
+            uint64 n = 0;
+            
+            other.clear();
+            
+            for(uint64 i : rest) {
+                if(!ne_genome::same_topology(first, genomes[i])) {
+                    other.push_back(i);
+                    continue;
+                }
+                
+                if(n != 0 && n % lanes == 0)
+                    offsets.push_back(k);
+                
+                members[k] = genomes[i];
+                streams[k].seed(seed, i);
+                
+                ++k;
+                ++n;
+            }
+            
+            offsets.push_back(k);
+            rest.swap(other);
+        }
+    }
+    
+    pool.run(offsets.size() - 1, [&](uint64 g, uint64 worker) {
+        fitness(members.data() + offsets[g], streams.data() + offsets[g], offsets[g + 1] - offsets[g], worker);
+    });
+    
+    _store();
+}
+
+void ne_population::_lookup() {
+    uint64 size = genomes.size();
+    
+    pending.clear();
+    copies.clear();
+    
+    cache_lookups = 0;
+    cache_hits = 0;
+    
+    if(params.cache_fitness == 0) {
+        for(uint64 i = 0; i != size; ++i) {
+            pending.push_back(i);
+        }
+        
+        return;
+    }
+    
+    signatures.resize(size);
+    keys.resize(size);
+    
+    pool.run(size, [this](uint64 i, uint64) {
+        genomes[i]->signature(signatures[i]);
+        
+        uint64 h = ne_mix(signatures[i].size());
+        
+        for(uint64 x : signatures[i]) {
+            h = ne_mix(h ^ x);
+        }
+        
+        keys[i] = h;
+    });
+    
+    std::unordered_map<uint64, uint64> first;
+    
+    for(uint64 i = 0; i != size; ++i) {
+        ++cache_lookups;
+        
+        std::unordered_map<uint64, ne_cached>::const_iterator cached = cache.find(keys[i]);
+        
+        if(cached != cache.end() && cached->second.signature == signatures[i]) {
+            genomes[i]->fitness = cached->second.fitness;
+            ++cache_hits;
+            continue;
+        }
+        
+        std::unordered_map<uint64, uint64>::const_iterator seen = first.find(keys[i]);
+        
+        if(seen != first.end() && signatures[seen->second] == signatures[i]) {
+            copies.push_back({ i, seen->second });
+            ++cache_hits;
+            continue;
+        }
+        
+        /// A colliding genome is scored, just not shared.
+        first.insert({ keys[i], i });
+        pending.push_back(i);
+    }
+}
+
+void ne_population::_store() {
+    if(params.cache_fitness == 0)
+        return;
+    
+    for(const std::pair<uint64, uint64>& copy : copies) {
+        genomes[copy.first]->fitness = genomes[copy.second]->fitness;
+    }
+    
+    /// Only the last evaluation is kept: champions carried over and babies
+    /// equal to a parent repeat a genome of the generation before.
+    cache.clear();
+    
+    for(uint64 i = 0; i != genomes.size(); ++i) {
+        ne_cached& entry = cache[keys[i]];
+        entry.signature.swap(signatures[i]);
+        entry.fitness = genomes[i]->fitness;
+    }
 }
 
 ne_genome* ne_population::select() {
+    NE_PROFILE_SCOPE(ne_timer_select);
+    
     uint64 offsprings = 0;
     
     float64 total_fitness = 0.0;
     
     ne_genome* best = genomes[0];
-
+    
     for(ne_species* sp : species) {        
         std::sort(sp->genomes.data(), sp->genomes.data() + sp->genomes.size(), ne_genome::compare);
         
@@ -106,7 +454,7 @@ ne_genome* ne_population::select() {
         
         if(sp->time_since_improvement <= params.dropoff_age || bf == best->fitness) {
             for(uint64 i = 0; i < spsize; ++i) {
-                if(isnan(sp->genomes[i]->fitness))
+                if(std::isnan(sp->genomes[i]->fitness))
                     sp->genomes[i]->fitness = 0.0;
                 
                 if(i < sp->parents)
@@ -126,6 +474,10 @@ ne_genome* ne_population::select() {
         }
         
         std::sort(species.data(), species.data() + species.size(), ne_species::compare);
+    }else{
+        for(ne_species* sp : species) {
+            sp->offsprings = 0;
+        }
     }
     
     uint64 leftover = params.population - offsprings;
@@ -141,9 +493,15 @@ ne_genome* ne_population::select() {
 }
 
 void ne_population::reproduce() {
+    NE_PROFILE_BEGIN(ne_timer_reproduce);
+    
+    steady = false;
     set.clear();
     
-    std::vector<ne_genome*> babies;
+    babies.clear();
+    parents.clear();
+    
+    arrived = 0;
     
     for(ne_species* sp : species) {
         for(ne_genome* g : sp->genomes) {
@@ -152,78 +510,578 @@ void ne_population::reproduce() {
         
         if(sp->offsprings != 0) {
             for(uint64 n = 1; n != sp->offsprings; ++n) {
-                babies.push_back(_breed(sp));
+                babies.push_back(_spawn());
+                parents.push_back(sp);
             }
             
             sp->genomes.front()->eliminated = false;
         }
     }
     
-    for(ne_genome* g : babies) {
-        _add(g);
-        genomes.push_back(g);
+    uint64 count = babies.size();
+    
+    if(logs.size() < count)
+        logs.resize(count);
+    
+    uint64 seed = ne_phase_seed(params.seed, generation, ne_phase_breed);
+    
+    pool.run(count, [this, seed](uint64 k, uint64) {
+        ne_rng rng;
+        rng.seed(seed, k);
+        ne_stream_scope scope(&rng);
+        
+        _breed(parents[k], babies[k], &logs[k]);
+    });
+    
+    for(uint64 k = 0; k != count; ++k) {
+        _register(&logs[k]);
     }
     
-    std::vector<ne_genome*>::iterator begin, end;
-    std::vector<ne_species*>::iterator p = species.begin(), q = species.end();
+    pool.run(count, [this](uint64 k, uint64) {
+        _resolve(babies[k], &logs[k]);
+        babies[k]->remap(ne_local, logs[k].innovation_map, logs[k].node_map);
+    });
+    
+    _add(babies.data(), babies.size());
+    
+    uint64 alive = 0;
     
-    while(q-- != p) {
-        begin = (*q)->genomes.begin();
-        end = (*q)->genomes.end();
+    for(ne_species* sp : species) {
+        uint64 size = 0;
         
-        while(end-- != begin) {
-            if((*end)->eliminated)
-                (*q)->genomes.erase(end);
+        for(ne_genome* g : sp->genomes) {
+            if(!g->eliminated)
+                sp->genomes[size++] = g;
         }
         
-        if((*q)->genomes.empty()) {
-            delete *q;
-            species.erase(q);
+        sp->genomes.resize(size);
+        
+        if(size == 0)
+            delete sp;
+        else
+            species[alive++] = sp;
+    }
+    
+    species.resize(alive);
+    
+    next.clear();
+    
+    for(ne_genome* g : genomes) {
+        if(g->eliminated)
+            recycled.push_back(g);
+        else
+            next.push_back(g);
+    }
+    
+    next.insert(next.end(), babies.begin(), babies.end());
+    
+    genomes.swap(next);
+    
+    NE_PROFILE_END(ne_timer_reproduce);
+
+#if defined(NE_PROFILE)
+    float64 genes = 0.0, nodes = 0.0, activations = 0.0;
+    
+    for(const ne_genome* g : genomes) {
+        genes += g->gene_count();
+        nodes += g->node_count();
+        activations += g->activations;
+    }
+    
+    float64 size = genomes.size();
+    ne_profiler::instance().commit(generation, genes / size, nodes / size, activations / size);
+#endif
+
+    ++generation;
+}
+
+ne_genome* ne_population::evolve(uint64 evaluations, const std::function<float64 (ne_genome* genome, uint64 worker)>& fitness) {
+    NE_PROFILE_SCOPE(ne_timer_evaluate);
+    
+    std::vector<ne_genome*> queue;
+    
+    if(!steady) {
+        for(ne_species* sp : species) {
+            delete sp;
         }
+        
+        species.clear();
+        
+        queue.assign(genomes.rbegin(), genomes.rend());
+        
+        leader = nullptr;
+        births = 0;
+        dispatched = 0;
+        steady = true;
     }
     
-    begin = genomes.begin();
-    end = genomes.end();
+    if(logs.size() < pool.size())
+        logs.resize(pool.size());
+    
+    std::mutex mutex;
+    std::condition_variable settled;
     
-    while(end-- != begin) {
-        if((*end)->eliminated) {
-            delete *end;
-            genomes.erase(end);
+    /// Genomes taken from the queue or bred and not settled yet.
+    uint64 active = 0;
+    
+    /// One task per evaluation, first the queue and then the births, each
+    /// holding the lock only to take its genome and to settle it.
+    pool.run(queue.size() + evaluations, [&](uint64, uint64 worker) {
+        ne_genome* genome = nullptr;
+        const ne_genome* a = nullptr;
+        const ne_genome* b = nullptr;
+        
+        ne_rng rng, breed;
+        
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            
+            if(!queue.empty()) {
+                genome = queue.back();
+                queue.pop_back();
+            }else{
+                /// Only genomes being scored could make way, so wait for one.
+                while(!_replace(&breed, &a, &b, &genome) && active != 0) {
+                    settled.wait(lock);
+                }
+                
+                if(genome == nullptr)
+                    return;
+                
+                ++readers;
+            }
+            
+            ++active;
+            
+            rng.seed(ne_phase_seed(params.seed, generation, ne_phase_evaluate), dispatched++);
+        }
+        
+        ne_log& log = logs[worker];
+        
+        if(a != nullptr) {
+            {
+                ne_stream_scope scope(&breed);
+                _make(a, b, genome, &log);
+            }
+            
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                
+                _register(&log);
+                
+                --readers;
+                _quiesce();
+            }
+            
+            _resolve(genome, &log);
+            genome->remap(ne_local, log.innovation_map, log.node_map);
+        }
+        
+        {
+            ne_stream_scope scope(&rng);
+            genome->fitness = fitness(genome, worker);
+        }
+        
+        std::vector<ne_species*> near;
+        std::vector<const ne_genome*> representatives;
+        
+        /// Species only grow while this worker reads, so those founded
+        /// since it looked are the ones from `first` on.
+        uint64 first;
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            
+            for(ne_species* sp : species) {
+                if(sp->genomes.empty()) continue;
+                
+                near.push_back(sp);
+                representatives.push_back(sp->genomes.front());
+            }
+            
+            first = species.size();
+            ++readers;
+        }
+        
+        float64 closest = params.compat_thresh;
+        ne_species* home = nullptr;
+        
+        for(uint64 k = 0; k != near.size(); ++k) {
+            float64 ts = ne_genome::distance(genome, representatives[k], params, closest);
+            
+            if(ts < closest) {
+                closest = ts;
+                home = near[k];
+            }
         }
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            
+            _settle(genome, home, closest, first);
+            
+            --active;
+            --readers;
+            _quiesce();
+        }
+        
+        settled.notify_all();
+    });
+    
+    _quiesce();
+    
+    genomes.clear();
+    
+    for(ne_species* sp : species) {
+        genomes.insert(genomes.end(), sp->genomes.begin(), sp->genomes.end());
     }
+    
+    return leader;
 }
 
-void ne_population::_speciate() {
+void ne_population::_settle(ne_genome* genome, ne_species* home, float64 closest, uint64 first) {
+    if(std::isnan(genome->fitness))
+        genome->fitness = 0.0;
+    
+    for(uint64 k = first; k < species.size(); ++k) {
+        ne_species* sp = species[k];
+        
+        if(sp->genomes.empty()) continue;
+        
+        float64 ts = ne_genome::distance(genome, sp->genomes.front(), params, closest);
+        
+        if(ts < closest) {
+            closest = ts;
+            home = sp;
+        }
+    }
+    
+    if(home == nullptr) {
+        home = new ne_species();
+        species.push_back(home);
+    }
+    
+    /// Species stay sorted by fitness, fittest first.
+    home->genomes.insert(std::upper_bound(home->genomes.begin(), home->genomes.end(), genome, ne_genome::compare), genome);
+    
+    home->fitness_sum += fmax(0.0, genome->fitness);
+    home->avg_fitness = home->fitness_sum / (float64) home->genomes.size();
+    
+    if(genome->fitness > home->max_fitness) {
+        home->time_since_improvement = 0;
+        home->max_fitness = genome->fitness;
+    }
+    
+    if(leader == nullptr || genome->fitness > leader->fitness)
+        leader = genome;
+}
+
+bool ne_population::_replace(ne_rng* rng, const ne_genome** a, const ne_genome** b, ne_genome** baby) {
+    if(leader == nullptr)
+        return false;
+    
+    ne_genome* worst = nullptr;
+    ne_species* victim = nullptr;
+    
+    /// Species that stopped improving count for nothing, as in select(),
+    /// unless they hold the fittest genome.
+    auto stale = [this](const ne_species* sp) {
+        return sp->time_since_improvement > params.dropoff_age && sp->max_fitness < leader->fitness;
+    };
+    
+    float64 lowest = 0.0;
+    
+    /// Fitness shared by species size, so no species takes over, with the
+    /// raw fitness breaking ties among those at zero. Within a species the
+    /// last genome is the lowest, unless it is the fittest of all.
     for(ne_species* sp : species) {
-        delete sp;
+        uint64 size = sp->genomes.size();
+        
+        if(size == 0) continue;
+        
+        ne_genome* g = sp->genomes.back();
+        
+        if(g == leader) {
+            if(size == 1) continue;
+            
+            g = sp->genomes[size - 2];
+        }
+        
+        float64 adjusted = stale(sp) ? 0.0 : fmax(0.0, g->fitness) / (float64) size;
+        
+        if(worst == nullptr || adjusted < lowest || (adjusted == lowest && g->fitness < worst->fitness)) {
+            worst = g;
+            victim = sp;
+            lowest = adjusted;
+        }
     }
     
-    species.clear();
+    if(worst == nullptr)
+        return false;
     
-    for(ne_genome* g : genomes) {
-        _add(g);
+    if(births == params.population) {
+        births = 0;
+        dispatched = 0;
+        set.clear();
+        ++generation;
+        
+        for(ne_species* sp : species) {
+            ++sp->time_since_improvement;
+        }
     }
+    
+    rng->seed(ne_phase_seed(params.seed, generation, ne_phase_breed), births++);
+    ne_stream_scope scope(rng);
+    
+    float64 total = 0.0;
+    uint64 alive = 0;
+    
+    for(ne_species* sp : species) {
+        if(sp->genomes.empty()) continue;
+        
+        total += stale(sp) ? 0.0 : sp->avg_fitness;
+        ++alive;
+    }
+    
+    ne_species* parent = nullptr;
+    
+    if(total != 0.0) {
+        float64 r = random(0.0, total);
+        
+        for(ne_species* sp : species) {
+            if(sp->genomes.empty()) continue;
+            
+            parent = sp;
+            r -= stale(sp) ? 0.0 : sp->avg_fitness;
+            
+            if(r < 0.0) break;
+        }
+    }else{
+        uint64 k = random(0, alive);
+        
+        for(ne_species* sp : species) {
+            if(sp->genomes.empty()) continue;
+            
+            parent = sp;
+            
+            if(k-- == 0) break;
+        }
+    }
+    
+    parent->parents = std::max((uint64) 1, (uint64) ceil(parent->genomes.size() * params.survive_thresh));
+    
+    _choose(parent, a, b);
+    
+    *baby = _spawn();
+    
+    /// `worst` is one of the last two, and may be a parent, so it is only
+    /// recycled once no worker reads the species.
+    victim->genomes.erase(victim->genomes.back() == worst ? victim->genomes.end() - 1 : victim->genomes.end() - 2);
+    
+    if(victim->genomes.empty()) {
+        victim->fitness_sum = 0.0;
+        victim->avg_fitness = 0.0;
+    }else{
+        victim->fitness_sum -= fmax(0.0, worst->fitness);
+        victim->avg_fitness = victim->fitness_sum / (float64) victim->genomes.size();
+    }
+    
+    worst->eliminated = true;
+    retired.push_back(worst);
+    
+    return true;
 }
 
-void ne_population::_add(ne_genome *g) {
-    ne_species* sp = nullptr;
-    float64 mc = params.compat_thresh;
+void ne_population::_quiesce() {
+    if(readers != 0)
+        return;
     
-    for(ne_species* s : species) {
-        ne_genome* j = s->genomes.front();
-        float64 ts = ne_genome::distance(g, j, params);
-        if(ts < mc) {
-            mc = ts;
-            sp = s;
+    recycled.insert(recycled.end(), retired.begin(), retired.end());
+    retired.clear();
+    
+    uint64 alive = 0;
+    
+    for(ne_species* sp : species) {
+        if(sp->genomes.empty())
+            delete sp;
+        else
+            species[alive++] = sp;
+    }
+    
+    species.resize(alive);
+}
+
+void ne_population::emigrate(std::vector<uint8>& out, uint64 count) const {
+    std::vector<ne_genome*> ranked(genomes);
+    
+    count = std::min(count, (uint64) ranked.size());
+    
+    /// Unscored genomes rank last.
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(), [](const ne_genome* a, const ne_genome* b) {
+        float64 x = std::isnan(a->fitness) ? -DBL_MAX : a->fitness;
+        float64 y = std::isnan(b->fitness) ? -DBL_MAX : b->fitness;
+        return x > y;
+    });
+    
+    ne_put(out, ne_migration_magic);
+    ne_put(out, count);
+    
+    for(uint64 k = 0; k != count; ++k) {
+        ranked[k]->write(out);
+    }
+}
+
+/// Gives `id` a local number from `counter` the first time it is seen. Ids
+/// below `base` are shared by every population and keep their number.
+static inline void ne_claim(std::vector<uint64>& table, uint64 base, uint64 id, uint64* counter) {
+    for(uint64 x = table.size(); x <= id; ++x) {
+        table.push_back(x < base ? x : ne_unmapped);
+    }
+    
+    if(table[id] == ne_unmapped)
+        table[id] = (*counter)++;
+}
+
+bool ne_population::immigrate(const uint8* data, uint64 size, uint64 source) {
+    ne_reader in = { data, data + size, true };
+    
+    if(in.get() != ne_migration_magic)
+        return false;
+    
+    uint64 count = in.get();
+    
+    const ne_genome* local = genomes.front();
+    
+    std::vector<ne_genome*> arrivals;
+    
+    for(uint64 i = 0; in.good && i != count; ++i) {
+        ne_genome* genome = _spawn();
+        uint64 used = genome->read(in.data, in.end - in.data);
+        
+        arrivals.push_back(genome);
+        
+        in.data += used;
+        in.good = used != 0 && genome->input_size == local->input_size && genome->output_size == local->output_size;
+    }
+    
+    if(!in.good) {
+        recycled.insert(recycled.end(), arrivals.begin(), arrivals.end());
+        return false;
+    }
+    
+    count = std::min(count, (uint64) babies.size() - arrived);
+    
+    recycled.insert(recycled.end(), arrivals.begin() + count, arrivals.end());
+    arrivals.resize(count);
+    
+    if(count == 0)
+        return true;
+    
+    if(foreign.size() <= source)
+        foreign.resize(source + 1);
+    
+    ne_foreign& f = foreign[source];
+    
+    uint64 node_base = local->input_size + local->output_size;
+    uint64 innovation_base = local->input_size * local->output_size;
+    
+    for(ne_genome* genome : arrivals) {
+        for(const ne_node* node : genome->nodes) {
+            ne_claim(f.node_map, node_base, node->id, &node_ids);
         }
+        
+        for(const ne_gene* gene : genome->genes) {
+            ne_claim(f.innovation_map, innovation_base, gene->innovation, &innovation);
+        }
+        
+        genome->remap(0, f.innovation_map, f.node_map);
     }
     
-    if(sp == nullptr) {
-        sp = new ne_species();
-        species.push_back(sp);
+    /// The newest babies not already replaced make way.
+    uint64 end = genomes.size() - arrived;
+    
+    for(uint64 k = 0; k != count; ++k) {
+        ne_genome*& slot = genomes[end - count + k];
+        
+        slot->eliminated = true;
+        recycled.push_back(slot);
+        slot = arrivals[k];
+    }
+    
+    uint64 alive = 0;
+    
+    for(ne_species* sp : species) {
+        uint64 size = 0;
+        
+        for(ne_genome* g : sp->genomes) {
+            if(!g->eliminated)
+                sp->genomes[size++] = g;
+        }
+        
+        sp->genomes.resize(size);
+        
+        if(size == 0)
+            delete sp;
+        else
+            species[alive++] = sp;
     }
     
-    sp->genomes.push_back(g);
+    species.resize(alive);
+    
+    _add(arrivals.data(), count);
+    
+    arrived += count;
+    
+    return true;
+}
+
+void ne_population::_speciate() {
+    for(ne_species* sp : species) {
+        delete sp;
+    }
+    
+    species.clear();
+    
+    _add(genomes.data(), genomes.size());
+}
+
+void ne_population::_add(ne_genome** list, uint64 n) {
+    NE_PROFILE_SCOPE(ne_timer_speciate);
+    
+    candidates.assign(n, { params.compat_thresh, ne_no_species, 0 });
+    
+    uint64 k = 0;
+    
+    while(k != n) {
+        uint64 m = species.size();
+        
+        pool.run(n - k, [this, list, k, m](uint64 i, uint64) {
+            ne_candidate& c = candidates[k + i];
+            
+            for(; c.scanned != m; ++c.scanned) {
+                float64 ts = ne_genome::distance(list[k + i], species[c.scanned]->genomes.front(), params, c.distance);
+                
+                if(ts < c.distance) {
+                    c.distance = ts;
+                    c.species = c.scanned;
+                }
+            }
+        });
+        
+        while(k != n) {
+            ne_genome* g = list[k];
+            ne_candidate& c = candidates[k++];
+            
+            if(c.species == ne_no_species) {
+                ne_species* sp = new ne_species();
+                sp->genomes.push_back(g);
+                species.push_back(sp);
+                break;
+            }
+            
+            species[c.species]->genomes.push_back(g);
+        }
+    }
 }
 
 void ne_population::_kill() {
@@ -231,10 +1089,252 @@ void ne_population::_kill() {
         delete g;
     }
     
+    for(ne_genome* g : recycled) {
+        delete g;
+    }
+    
     for(ne_species* sp : species) {
         delete sp;
     }
     
     genomes.clear();
     species.clear();
+    recycled.clear();
+}
+
+void ne_population::_snapshot(ne_snapshot& out) const {
+    out.params = params;
+    out.innovation = innovation;
+    out.node_ids = node_ids;
+    out.generation = generation;
+    
+    std::unordered_map<const ne_genome*, uint64> index;
+    
+    out.genomes.resize(genomes.size());
+    
+    for(uint64 i = 0; i != genomes.size(); ++i) {
+        index[genomes[i]] = i;
+        genomes[i]->_pack(out.genomes[i]);
+    }
+    
+    out.species.clear();
+    
+    for(const ne_species* sp : species) {
+        out.species.push_back(ne_bits(sp->avg_fitness));
+        out.species.push_back(ne_bits(sp->max_fitness));
+        out.species.push_back(sp->time_since_improvement);
+        out.species.push_back(sp->parents);
+        out.species.push_back(sp->offsprings);
+        
+        out.species.push_back(sp->genomes.size());
+        
+        for(const ne_genome* g : sp->genomes) {
+            out.species.push_back(index[g]);
+        }
+    }
+    
+    out.species_count = species.size();
+    out.set.assign(set.begin(), set.end());
+}
+
+void ne_population::_serialize(ne_snapshot& in, std::vector<uint8>& out) {
+    /// In innovation order, since the set's own order depends on how it
+    /// was filled and a loaded population would save different bytes.
+    std::sort(in.set.begin(), in.set.end(), [](const ne_innovation& a, const ne_innovation& b) {
+        return a.innovation1 < b.innovation1;
+    });
+    
+    ne_put(out, ne_checkpoint_magic);
+    ne_put(out, ne_checkpoint_version);
+    
+    ne_put(out, ne_params::n);
+    
+    for(uint64 i = 0; i != ne_params::n; ++i) {
+        ne_put(out, (&in.params.begin_float)[i]);
+    }
+    
+    ne_put(out, in.innovation);
+    ne_put(out, in.node_ids);
+    ne_put(out, in.generation);
+    
+    ne_put(out, in.genomes.size());
+    
+    /// Packed genomes are already little-endian.
+    for(const std::vector<uint64>& words : in.genomes) {
+        uint64 size = out.size();
+        out.resize(size + words.size() * sizeof(uint64));
+        memcpy(out.data() + size, words.data(), words.size() * sizeof(uint64));
+    }
+    
+    ne_put(out, in.species_count);
+    
+    for(uint64 word : in.species) {
+        ne_put(out, word);
+    }
+    
+    ne_put(out, in.set.size());
+    
+    for(const ne_innovation& p : in.set) {
+        ne_put(out, p.type);
+        ne_put(out, p.i);
+        ne_put(out, p.j);
+        ne_put(out, p.innovation1);
+        ne_put(out, p.innovation2);
+        ne_put(out, p.id);
+        ne_put(out, ne_bits(p.weight));
+    }
+}
+
+void ne_population::save(std::vector<uint8>& out) const {
+    ne_snapshot copy;
+    
+    _snapshot(copy);
+    _serialize(copy, out);
+}
+
+bool ne_population::load(const uint8* data, uint64 size) {
+    ne_reader in = { data, data + size, true };
+    
+    if(in.get() != ne_checkpoint_magic || in.get() != ne_checkpoint_version || in.get() != ne_params::n)
+        return false;
+    
+    ne_params saved = params;
+    
+    for(uint64 i = 0; i != ne_params::n; ++i) {
+        (&saved.begin_float)[i] = in.get();
+    }
+    
+    saved.threads = params.threads;
+    saved.cache_fitness = params.cache_fitness;
+    
+    uint64 saved_innovation = in.get();
+    uint64 saved_node_ids = in.get();
+    uint64 saved_generation = in.get();
+    
+    if(!in.good)
+        return false;
+    
+    _kill();
+    
+    params = saved;
+    innovation = saved_innovation;
+    node_ids = saved_node_ids;
+    generation = saved_generation;
+    
+    pool.reset(params.threads);
+    
+    set.clear();
+    cache.clear();
+    foreign.clear();
+    steady = false;
+    
+    uint64 count = in.get();
+    
+    for(uint64 i = 0; in.good && i != count; ++i) {
+        ne_genome* genome = new ne_genome();
+        uint64 used = genome->read(in.data, in.end - in.data);
+        
+        genomes.push_back(genome);
+        
+        in.data += used;
+        in.good = used != 0;
+    }
+    
+    count = in.count(6);
+    
+    for(uint64 i = 0; i != count; ++i) {
+        ne_species* sp = new ne_species();
+        species.push_back(sp);
+        
+        sp->avg_fitness = ne_float(in.get());
+        sp->max_fitness = ne_float(in.get());
+        sp->time_since_improvement = in.get();
+        sp->parents = in.get();
+        sp->offsprings = in.get();
+        
+        uint64 size = in.count(1);
+        
+        for(uint64 k = 0; k != size; ++k) {
+            uint64 g = in.get();
+            
+            if(g >= genomes.size()) {
+                in.good = false;
+                break;
+            }
+            
+            sp->genomes.push_back(genomes[g]);
+        }
+    }
+    
+    count = in.count(7);
+    
+    for(uint64 i = 0; i != count; ++i) {
+        ne_innovation p;
+        
+        p.type = (uint32) in.get();
+        p.i = in.get();
+        p.j = in.get();
+        p.innovation1 = in.get();
+        p.innovation2 = in.get();
+        p.id = in.get();
+        p.weight = ne_float(in.get());
+        
+        set.insert(p);
+    }
+    
+    if(!in.good) {
+        _kill();
+        return false;
+    }
+    
+    return true;
+}
+
+void ne_population::checkpoint(const std::string& path) {
+    sync();
+    
+    _snapshot(snapshot);
+    
+    written = false;
+    
+    writer = std::thread([this, path]() {
+        std::string temporary = path + ".tmp";
+        
+        bytes.clear();
+        _serialize(snapshot, bytes);
+        
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write((const char*) bytes.data(), bytes.size());
+            
+            if(!out.good())
+                return;
+        }
+        
+        written = std::rename(temporary.c_str(), path.c_str()) == 0;
+    });
+}
+
+bool ne_population::restore(const std::string& path) {
+    sync();
+    
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    
+    if(!in.is_open())
+        return false;
+    
+    std::vector<uint8> data((uint64) in.tellg());
+    in.seekg(0);
+    
+    if(!in.read((char*) data.data(), data.size()))
+        return false;
+    
+    return load(data.data(), data.size());
+}
+
+bool ne_population::sync() {
+    if(writer.joinable())
+        writer.join();
+    
+    return written;
 }
@@ -0,0 +1,280 @@
+//
+//  population.h
+//  NeuroEvolution
+//
+//  Created by Arthur Sun on 7/31/19.
+//  Copyright © 2019 Arthur Sun. All rights reserved.
+//
+
+#ifndef ne_population_h
+#define ne_population_h
+
+#include "species.h"
+#include "threads.h"
+#include <string>
+#include <unordered_map>
+
+class ne_population
+{
+    
+public:
+    
+    ~ne_population() {
+        sync();
+        _kill();
+    }
+    
+    ne_population() {}
+    
+    ne_population(const ne_population& population) {
+        *this = population;
+    }
+    
+    ne_population& operator = (const ne_population& population);
+    
+    void reset(const ne_params& _params, uint64 input_size, uint64 output_size);
+    
+    inline ne_genome* operator [] (uint64 i) {
+        return genomes[i];
+    }
+    
+    inline uint64 workers() const {
+        return pool.size();
+    }
+    
+    /// Each genome is scored under its own random stream, so stochastic
+    /// tasks give the same fitness for a given seed on any thread count.
+    /// With params.cache_fitness set, genomes whose ne_genome::signature
+    /// matches one scored in this or the previous evaluation are not scored
+    /// and take that fitness instead; evaluate_groups does the same.
+    void evaluate(const std::function<float64 (ne_genome* genome, uint64 worker)>& fitness);
+    
+    /// Scores genomes that share a topology together, for tasks that run
+    /// them as one ne_group. Genomes are grouped by ne_genome::topology,
+    /// confirmed with same_topology, into groups of at most `lanes`. The
+    /// task gets each group with the random streams evaluate() would give
+    /// its genomes, and sets their fitness.
+    void evaluate_groups(const std::function<void (ne_genome* const* genomes, ne_rng* streams, uint64 count, uint64 worker)>& fitness, uint64 lanes = 64);
+    
+    ne_genome* select();
+    
+    void reproduce();
+    
+    /// Steady-state evolution, as in rtNEAT. Each pool task scores one
+    /// genome and then places it in its closest species. Once every genome
+    /// has a score, the next one is a baby bred on the spot from a species
+    /// drawn in proportion to average fitness. It replaces the genome with
+    /// the lowest fitness shared by its species' size, never the fittest
+    /// one; while only genomes being scored could make way, a task waits for
+    /// one. Only scored genomes are in species, so breeding never reads a
+    /// genome still being scored. Every params.population births count as
+    /// a generation.
+    ///
+    /// Workers share one lock, held only for the bookkeeping: species keep
+    /// their genomes sorted and their fitness summed as they change, and
+    /// copying, crossover, mutation and the distances to the species run
+    /// outside it.
+    ///
+    /// Returns after `evaluations` babies have been scored, with every
+    /// genome scored and speciated, so select() may follow. A population of
+    /// one genome has nothing to replace and is only scored. The first call
+    /// after reset() or reproduce() first rescores the whole population;
+    /// later calls carry on where the last one stopped. Births follow the
+    /// order in which evaluations finish, so results depend on the thread
+    /// count. Returns the fittest genome.
+    ne_genome* evolve(uint64 evaluations, const std::function<float64 (ne_genome* genome, uint64 worker)>& fitness);
+    
+    /// Appends the binary form of the `count` fittest genomes, as scored for
+    /// the last select(), for another population to immigrate(). Call it
+    /// before reproduce().
+    void emigrate(std::vector<uint8>& out, uint64 count) const;
+    
+    /// Replaces the newest babies with genomes another population
+    /// emigrated and speciates them; call it after reproduce(). Node ids and
+    /// innovations past those every population starts with are numbered by
+    /// each population on its own, so they are renumbered into this one's
+    /// through tables kept per `source`. The same foreign gene gets the
+    /// same number every time it arrives, and aligns with its relatives in
+    /// ne_genome::distance. The tables are not part of a checkpoint.
+    bool immigrate(const uint8* data, uint64 size, uint64 source);
+    
+    /// Reassigns every genome to species from scratch.
+    inline void speciate() {
+        _speciate();
+    }
+    
+    /// Serializes the whole evolutionary state: params, counters, genomes,
+    /// species and the innovation set. Random streams are derived from
+    /// params.seed and the generation, so a loaded population continues
+    /// bit for bit from where it was saved.
+    void save(std::vector<uint8>& out) const;
+    
+    /// Replaces the population with a saved one. The thread count and
+    /// cache_fitness stay the caller's, since results do not depend on them.
+    bool load(const uint8* data, uint64 size);
+    
+    /// Copies the population into memory and writes it to `path` on a
+    /// background thread, through a temporary file renamed into place. The
+    /// copy holds each genome in its packed binary form; the writer
+    /// serializes it, so only the copy costs the caller.
+    void checkpoint(const std::string& path);
+    
+    bool restore(const std::string& path);
+    
+    /// Waits for the last checkpoint and returns whether it reached disk.
+    bool sync();
+    
+    std::vector<ne_genome*> genomes;
+    std::vector<ne_species*> species;
+    
+    ne_params params;
+    
+    uint64 innovation;
+    uint64 node_ids;
+    uint64 generation;
+    
+    /// Genomes looked up in and answered by the fitness cache during the
+    /// last evaluation.
+    uint64 cache_lookups = 0;
+    uint64 cache_hits = 0;
+    
+private:
+    
+    ne_innovation_set set;
+    
+    ne_thread_pool pool;
+    
+    /// Everything save() writes, before it is serialized.
+    struct ne_snapshot
+    {
+        ne_params params;
+        
+        uint64 innovation;
+        uint64 node_ids;
+        uint64 generation;
+        
+        std::vector<std::vector<uint64>> genomes;
+        
+        /// The species records as saved, genomes by index.
+        uint64 species_count;
+        std::vector<uint64> species;
+        
+        std::vector<ne_innovation> set;
+    };
+    
+    std::thread writer;
+    ne_snapshot snapshot;
+    std::vector<uint8> bytes;
+    bool written = true;
+    
+    std::vector<ne_genome*> recycled;
+    std::vector<ne_genome*> babies;
+    
+    /// Babies replaced by immigrants since the last reproduce().
+    uint64 arrived = 0;
+    
+    /// Whether the species hold exactly the genomes evolve() has scored.
+    bool steady = false;
+    
+    /// Births and dispatched evaluations of evolve() in this generation.
+    uint64 births = 0;
+    uint64 dispatched = 0;
+    
+    /// The fittest genome in the species of evolve().
+    ne_genome* leader = nullptr;
+    
+    /// Workers of evolve() reading species genomes outside its lock. While
+    /// any are, replaced genomes wait in `retired` and emptied species stay
+    /// in place, so what they read stays valid and species only grow.
+    uint64 readers = 0;
+    std::vector<ne_genome*> retired;
+    std::vector<ne_genome*> next;
+    
+    struct ne_candidate
+    {
+        float64 distance;
+        uint64 species;
+        uint64 scanned;
+    };
+    
+    std::vector<ne_candidate> candidates;
+    
+    struct ne_log
+    {
+        ne_innovation_set set;
+        
+        uint64 innovation;
+        uint64 node_ids;
+        
+        std::vector<uint64> innovation_map;
+        std::vector<uint64> node_map;
+    };
+    
+    std::vector<ne_log> logs;
+    std::vector<ne_species*> parents;
+    
+    struct ne_cached
+    {
+        std::vector<uint64> signature;
+        float64 fitness;
+    };
+    
+    /// The genomes of the last evaluation by the hash of their signature.
+    std::unordered_map<uint64, ne_cached> cache;
+    
+    std::vector<std::vector<uint64>> signatures;
+    std::vector<uint64> keys;
+    
+    /// The genomes to score, and the later duplicates within one evaluation
+    /// with the genome whose fitness they copy.
+    std::vector<uint64> pending;
+    std::vector<std::pair<uint64, uint64>> copies;
+    
+    /// Local numbers of another population's node ids and innovations,
+    /// indexed by theirs.
+    struct ne_foreign
+    {
+        std::vector<uint64> innovation_map;
+        std::vector<uint64> node_map;
+    };
+    
+    std::vector<ne_foreign> foreign;
+    
+    ne_genome* _spawn();
+    void _breed(ne_species* sp, ne_genome* baby, ne_log* log);
+    
+    /// The two halves of _breed: drawing the parents from `sp`, where `b`
+    /// is nullptr for a mutated copy of `a`, and making the baby of them.
+    void _choose(ne_species* sp, const ne_genome** a, const ne_genome** b);
+    void _make(const ne_genome* a, const ne_genome* b, ne_genome* baby, ne_log* log);
+    void _register(ne_log* log);
+    
+    /// A crossover child can hold the node an earlier birth of the
+    /// generation split a gene into, and have split that gene again. The
+    /// innovation set gives both splits the same node, so the baby takes
+    /// its own split back before remap().
+    void _resolve(ne_genome* baby, const ne_log* log);
+    
+    void _kill();
+    
+    void _snapshot(ne_snapshot& out) const;
+    static void _serialize(ne_snapshot& in, std::vector<uint8>& out);
+    
+    void _lookup();
+    void _store();
+    
+    void _speciate();
+    void _add(ne_genome** list, uint64 n);
+    
+    /// Bookkeeping of evolve(), run under its lock. _settle places a
+    /// scored genome in `home`, found among the first `first` species, or
+    /// in a closer one founded since. _replace picks the genome to make
+    /// way and the parents of its replacement, or returns false if only
+    /// the fittest genome could make way.
+    void _settle(ne_genome* genome, ne_species* home, float64 closest, uint64 first);
+    bool _replace(ne_rng* rng, const ne_genome** a, const ne_genome** b, ne_genome** baby);
+    void _quiesce();
+
+};
+
+#endif /* ne_population_h */
@@ -0,0 +1,316 @@
+//
+//  profiler.h
+//  NeuroEvolution
+//
+
+#ifndef ne_profiler_h
+#define ne_profiler_h
+
+#include "common.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum ne_timer
+{
+    ne_timer_evaluate = 0,
+    ne_timer_select,
+    ne_timer_reproduce,
+    ne_timer_speciate,
+    ne_timer_count
+};
+
+enum ne_counter
+{
+    ne_counter_distance = 0,
+    ne_counter_genes,
+    ne_counter_lookups,
+    ne_counter_hits,
+    ne_counter_created,
+    ne_counter_destroyed,
+    ne_counter_count
+};
+
+/// One generation: exclusive wall time per phase in seconds, the counters
+/// it added and the population's average size when it ended. `thread`
+/// numbers the thread that ran the generation, in the order threads first
+/// used the profiler.
+struct ne_profile_record
+{
+    uint64 generation;
+    uint64 thread;
+    
+    float64 time[ne_timer_count];
+    uint64 counters[ne_counter_count];
+    
+    float64 genes;
+    float64 nodes;
+    float64 activations;
+    
+    float64 mark;
+};
+
+/// Phase timers and event counters, built with NE_PROFILE defined. Every
+/// thread keeps its own timers, events, records and counters, so profiling
+/// takes no lock after a thread's first call, and populations on several
+/// threads, as ne_islands runs them, time their phases separately. A timer
+/// started inside another pauses it, so a phase's time excludes the phases
+/// it contains. The per-thread state is merged when it is reported; call
+/// history() and write_trace() once the threads are done. Counters are
+/// process-wide: commit() sums them over every thread. Without NE_PROFILE
+/// the hooks below expand to nothing and no records are ever made.
+class ne_profiler
+{
+    
+public:
+    
+    static inline ne_profiler& instance() {
+        static ne_profiler profiler;
+        return profiler;
+    }
+    
+    /// Only the owning thread writes a counter, so a relaxed load and store
+    /// is enough for commit() to read it from another thread.
+    inline void count(ne_counter counter, uint64 n) {
+        std::atomic<uint64>& c = _local().counters[counter];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    
+    inline void begin(ne_timer timer) {
+        ne_local& local = _local();
+        ne_clock::time_point now = ne_clock::now();
+        
+        if(!local.open.empty())
+            local.current[local.open.back().timer] += _seconds(local.resumed, now);
+        
+        local.open.push_back({ timer, now });
+        local.resumed = now;
+    }
+    
+    inline void end(ne_timer timer) {
+        ne_local& local = _local();
+        ne_clock::time_point now = ne_clock::now();
+        
+        ne_open top = local.open.back();
+        local.open.pop_back();
+        
+        local.current[timer] += _seconds(local.resumed, now);
+        local.resumed = now;
+        
+        local.events.push_back({ timer, _microseconds(top.start), _seconds(top.start, now) * 1e6 });
+    }
+    
+    /// Closes the calling thread's generation and records it.
+    void commit(uint64 generation, float64 genes, float64 nodes, float64 activations) {
+        ne_local& local = _local();
+        ne_profile_record record;
+        
+        record.generation = generation;
+        record.thread = local.thread;
+        record.genes = genes;
+        record.nodes = nodes;
+        record.activations = activations;
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            
+            uint64 totals[ne_counter_count] = {};
+            
+            for(const std::unique_ptr<ne_local>& slot : slots) {
+                for(uint64 c = 0; c != ne_counter_count; ++c) {
+                    totals[c] += slot->counters[c].load(std::memory_order_relaxed);
+                }
+            }
+            
+            for(uint64 c = 0; c != ne_counter_count; ++c) {
+                record.counters[c] = totals[c] - committed[c];
+                committed[c] = totals[c];
+            }
+        }
+        
+        for(uint64 t = 0; t != ne_timer_count; ++t) {
+            record.time[t] = local.current[t];
+            local.current[t] = 0.0;
+        }
+        
+        record.mark = _microseconds(ne_clock::now());
+        local.records.push_back(record);
+    }
+    
+    /// Every thread's records, in the order they were committed.
+    std::vector<ne_profile_record> history() {
+        std::vector<ne_profile_record> merged;
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        for(const std::unique_ptr<ne_local>& slot : slots) {
+            merged.insert(merged.end(), slot->records.begin(), slot->records.end());
+        }
+        
+        std::stable_sort(merged.begin(), merged.end(), [](const ne_profile_record& a, const ne_profile_record& b) {
+            return a.mark < b.mark;
+        });
+        
+        return merged;
+    }
+    
+    /// Writes every phase as a complete event on its thread's track and
+    /// every generation's counters as counter events, in Chrome's trace
+    /// event format.
+    bool write_trace(const std::string& path) {
+        std::ofstream out(path);
+        
+        if(!out.is_open())
+            return false;
+        
+        out << "{\"traceEvents\": [" << std::endl;
+        
+        bool first = true;
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            
+            for(const std::unique_ptr<ne_local>& slot : slots) {
+                for(const ne_event& e : slot->events) {
+                    out << (first ? "" : ",\n") << "{\"name\": \"" << timer_names()[e.timer] << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << slot->thread << ", \"ts\": " << e.begin << ", \"dur\": " << e.duration << "}";
+                    first = false;
+                }
+            }
+        }
+        
+        for(const ne_profile_record& r : history()) {
+            for(uint64 c = 0; c != ne_counter_count; ++c) {
+                out << (first ? "" : ",\n") << "{\"name\": \"" << counter_names()[c] << "\", \"ph\": \"C\", \"pid\": 0, \"ts\": " << r.mark << ", \"args\": {\"value\": " << r.counters[c] << "}}";
+                first = false;
+            }
+            
+            out << ",\n{\"name\": \"size\", \"ph\": \"C\", \"pid\": 0, \"ts\": " << r.mark << ", \"args\": {\"genes\": " << r.genes << ", \"nodes\": " << r.nodes << ", \"activations\": " << r.activations << "}}";
+        }
+        
+        out << std::endl << "]}" << std::endl;
+        
+        return out.good();
+    }
+    
+    static inline const char* const* timer_names() {
+        static const char* const names[] = { "evaluate", "select", "reproduce", "speciate" };
+        return names;
+    }
+    
+    static inline const char* const* counter_names() {
+        static const char* const names[] = { "distance_calls", "genes_allocated", "innovation_lookups", "innovation_hits", "genomes_created", "genomes_destroyed" };
+        return names;
+    }
+    
+private:
+    
+    typedef std::chrono::steady_clock ne_clock;
+    
+    struct ne_event
+    {
+        uint64 timer;
+        
+        float64 begin;
+        float64 duration;
+    };
+    
+    struct ne_open
+    {
+        uint64 timer;
+        ne_clock::time_point start;
+    };
+    
+    /// One thread's state. Slots outlive their threads, so the records of
+    /// an island's thread are still there after it is joined.
+    struct ne_local
+    {
+        uint64 thread;
+        
+        std::atomic<uint64> counters[ne_counter_count];
+        
+        /// The timers running, innermost last, and when the innermost one
+        /// last started or resumed.
+        std::vector<ne_open> open;
+        ne_clock::time_point resumed;
+        
+        float64 current[ne_timer_count] = {};
+        
+        std::vector<ne_event> events;
+        std::vector<ne_profile_record> records;
+    };
+    
+    ne_profiler() : origin(ne_clock::now()) {}
+    
+    inline ne_local& _local() {
+        static thread_local ne_local* local = nullptr;
+        
+        if(local == nullptr) {
+            std::lock_guard<std::mutex> lock(mutex);
+            
+            slots.emplace_back(new ne_local());
+            local = slots.back().get();
+            local->thread = slots.size() - 1;
+            
+            for(std::atomic<uint64>& c : local->counters) {
+                c.store(0, std::memory_order_relaxed);
+            }
+        }
+        
+        return *local;
+    }
+    
+    static inline float64 _seconds(ne_clock::time_point a, ne_clock::time_point b) {
+        return std::chrono::duration<float64>(b - a).count();
+    }
+    
+    inline float64 _microseconds(ne_clock::time_point t) const {
+        return std::chrono::duration<float64, std::micro>(t - origin).count();
+    }
+    
+    ne_clock::time_point origin;
+    
+    uint64 committed[ne_counter_count] = {};
+    
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ne_local>> slots;
+};
+
+struct ne_profile_scope
+{
+    ne_timer timer;
+    
+    ne_profile_scope(ne_timer timer) : timer(timer) {
+        ne_profiler::instance().begin(timer);
+    }
+    
+    ~ne_profile_scope() {
+        ne_profiler::instance().end(timer);
+    }
+};
+
+#if defined(NE_PROFILE)
+
+#define NE_PROFILE_JOIN(a, b) a##b
+#define NE_PROFILE_NAME(line) NE_PROFILE_JOIN(ne_profile_scope_, line)
+
+#define NE_PROFILE_SCOPE(timer) ne_profile_scope NE_PROFILE_NAME(__LINE__)(timer)
+#define NE_PROFILE_BEGIN(timer) ne_profiler::instance().begin(timer)
+#define NE_PROFILE_END(timer) ne_profiler::instance().end(timer)
+#define NE_COUNT(counter, n) ne_profiler::instance().count(counter, n)
+
+#else
+
+#define NE_PROFILE_SCOPE(timer)
+#define NE_PROFILE_BEGIN(timer)
+#define NE_PROFILE_END(timer)
+#define NE_COUNT(counter, n)
+
+#endif
+
+#endif /* ne_profiler_h */
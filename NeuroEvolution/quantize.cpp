@@ -0,0 +1,492 @@
+//
+//  quantize.cpp
+//  NeuroEvolution
+//
+
+#include "quantize.h"
+#include <algorithm>
+#include <limits>
+
+/// "NEQN"
+static const uint64 ne_quantized_magic = 0x4e51454e;
+static const uint64 ne_quantized_version = 2;
+
+static const uint64 ne_quantized_header = 11;
+
+/// The most fraction bits a slot's weights get.
+static const uint64 ne_weight_shift_limit = 30;
+
+/// Table entries sit at x = k / 64 - 16 and are Q14.
+static const int64 ne_table_step = 6;
+static const int64 ne_table_range = 16;
+static const uint64 ne_table_size = 2 * ne_table_range * 64 + 1;
+
+struct ne_tables
+{
+    int16 entries[ne_activation_count][ne_table_size];
+    
+    ne_tables() {
+        for(uint64 f = 0; f != ne_activation_count; ++f) {
+            for(uint64 k = 0; k != ne_table_size; ++k) {
+                float64 x = ldexp((float64) k, -ne_table_step) - ne_table_range;
+                float64 y = std::round(ldexp(ne_activate((uint8) f, x), 14));
+                
+                entries[f][k] = (int16) std::min(std::max(y, -32768.0), 32767.0);
+            }
+        }
+    }
+};
+
+static const ne_tables& ne_activation_tables() {
+    static const ne_tables tables;
+    return tables;
+}
+
+static int16 ne_fixed(float64 x, uint64 shift) {
+    if(x != x)
+        return 0;
+    
+    return (int16) std::min(std::max(std::round(ldexp(x, (int) shift)), -32768.0), 32767.0);
+}
+
+static void ne_put(std::vector<uint8>& out, uint64 x, uint64 bytes) {
+    for(uint64 b = 0; b != bytes; ++b) {
+        out.push_back((uint8) (x >> (8 * b)));
+    }
+}
+
+static uint64 ne_get(const uint8*& p, uint64 bytes) {
+    uint64 x = 0;
+    
+    for(uint64 b = 0; b != bytes; ++b) {
+        x |= (uint64) *p++ << (8 * b);
+    }
+    
+    return x;
+}
+
+template <class W>
+void ne_basic_quantized<W>::compile(const ne_genome* genome, const float64* samples, uint64 count, bool feed_forward) {
+    ne_phenotype64 net(genome, feed_forward);
+    
+    uint64 size = net.values.size();
+    uint64 inputs_size = net.input_count();
+    
+    input_size = net.input_size;
+    output_size = net.output_size;
+    bias_node = net.bias_node;
+    hidden_begin = net.hidden_begin;
+    activations = net.activations;
+    
+    sorted = feed_forward;
+    forward = net.forward;
+    order = net.order;
+    
+    values.resize(size);
+    sums.resize(size);
+    activated.assign(net.activated.begin(), net.activated.end());
+    computed.resize(size);
+    functions.assign(net.functions.begin(), net.functions.end());
+    
+    std::fill(functions.begin(), functions.begin() + hidden_begin, (uint8) ne_identity);
+    
+    std::vector<float64> start(net.values.begin(), net.values.end());
+    
+    float64 high = 1.0;
+    
+    for(float64 v : start) {
+        high = std::max(high, fabs(v));
+    }
+    
+    /// Values between sweeps must fit as well, so the sweeps are run one
+    /// at a time.
+    uint64 sweeps = net.forward ? 1 : activations;
+    
+    net.activations = net.forward ? activations : 1;
+    net.reset();
+    net.flush();
+    
+    for(uint64 k = 0; k != count; ++k) {
+        std::copy(samples + k * inputs_size, samples + (k + 1) * inputs_size, net.inputs());
+        
+        for(uint64 n = 0; n != sweeps; ++n) {
+            net.compute();
+            
+            for(float64 v : net.values) {
+                high = std::max(high, fabs(v));
+            }
+        }
+    }
+    
+    value_shift = 0;
+    
+    while(value_shift != 14 && ldexp(high, (int) value_shift + 1) <= 32767.0) {
+        ++value_shift;
+    }
+    
+    float64 limit = std::numeric_limits<W>::max();
+    
+    offsets.assign(1, 0);
+    shifts.resize(size);
+    sources.clear();
+    weights.clear();
+    
+    /// Each slot's weights get as many fraction bits as its own largest
+    /// one allows, so a slot of small weights does not lose them to the
+    /// largest weight elsewhere in the network.
+    for(uint64 j = 0; j != size; ++j) {
+        float64 top = 0.0;
+        
+        for(uint64 e = net.ranges[j].begin; e != net.ranges[j].end; ++e) {
+            top = std::max(top, fabs(net.weights[e]));
+        }
+        
+        uint64 shift = 0;
+        
+        while(shift != ne_weight_shift_limit && ldexp(top, (int) shift + 1) <= limit) {
+            ++shift;
+        }
+        
+        shifts[j] = (uint8) shift;
+        
+        for(uint64 e = net.ranges[j].begin; e != net.ranges[j].end; ++e) {
+            float64 w = std::round(ldexp(net.weights[e], (int) shift));
+            
+            sources.push_back(net.sources[e]);
+            weights.push_back((W) std::min(std::max(w, -limit), limit));
+        }
+        
+        offsets.push_back((uint32) sources.size());
+    }
+    
+    for(uint64 j = 0; j != size; ++j) {
+        values[j] = ne_fixed(start[j], value_shift);
+    }
+}
+
+template <class W>
+uint64 ne_basic_quantized<W>::weight_bits() const {
+    uint64 fewest = ne_weight_shift_limit;
+    
+    for(uint64 j = 0; j != shifts.size(); ++j) {
+        if(offsets[j] != offsets[j + 1])
+            fewest = std::min(fewest, (uint64) shifts[j]);
+    }
+    
+    return fewest;
+}
+
+template <class W>
+uint64 ne_basic_quantized<W>::footprint() const {
+    uint64 size = values.size();
+    
+    return size * (sizeof(int16) + sizeof(int64) + 2 + 2) + offsets.size() * sizeof(uint32) + order.size() * sizeof(uint32) + sources.size() * sizeof(uint32) + weights.size() * sizeof(W);
+}
+
+/// Rounds x, with `shift` fraction bits, to the value format.
+template <class W>
+inline int16 ne_basic_quantized<W>::_value(int64 x, uint64 shift) const {
+    if(shift != 0)
+        x = (x + ((int64) 1 << (shift - 1))) >> shift;
+    
+    return (int16) std::min<int64>(std::max<int64>(x, -32768), 32767);
+}
+
+/// `sum` has value_shift + shifts[j] fraction bits. It is at most the
+/// edge count times 2^30 in magnitude, so the shifts below cannot overflow.
+template <class W>
+inline int16 ne_basic_quantized<W>::_activate(uint32 j, int64 sum) const {
+    uint64 weight_shift = shifts[j];
+    uint64 shift = value_shift + weight_shift;
+    uint8 function = functions[j];
+    
+    switch(function) {
+        case ne_softsign: {
+            int64 d = ((int64) 1 << shift) + std::abs(sum);
+            int64 n = sum * ((int64) 1 << value_shift);
+            int64 q = (n + (n < 0 ? -d : d) / 2) / d;
+            
+            return _value(((int64) 1 << value_shift) + q, 0);
+        }
+        
+        case ne_relu:
+            return _value(std::max<int64>(sum, 0), weight_shift);
+        
+        case ne_tanh:
+        case ne_sigmoid:
+        case ne_gaussian: {
+            const int16* table = ne_activation_tables().entries[function];
+            
+            /// x with 14 fraction bits, ne_table_step of them the index.
+            int64 p = shift > 14 ? sum >> (shift - 14) : sum * ((int64) 1 << (14 - shift));
+            int64 r = ne_table_range << 14;
+            
+            p = std::min(std::max(p, -r), r) + r;
+            
+            int64 k = p >> (14 - ne_table_step), f = p & ((1 << (14 - ne_table_step)) - 1);
+            
+            if(k == (int64) ne_table_size - 1) {
+                --k;
+                f = 1 << (14 - ne_table_step);
+            }
+            
+            int64 y = table[k] + (((table[k + 1] - table[k]) * f + (1 << (13 - ne_table_step))) >> (14 - ne_table_step));
+            
+            return _value(y, 14 - value_shift);
+        }
+        
+        default:
+            return _value(sum, weight_shift);
+    }
+}
+
+template <class W>
+void ne_basic_quantized<W>::reset() {
+    std::fill(values.begin(), values.end(), 0);
+    std::fill(activated.begin(), activated.end(), 0);
+}
+
+template <class W>
+void ne_basic_quantized<W>::flush() {
+    uint64 size = values.size();
+    
+    for(uint64 i = 0; i != size; ++i) {
+        activated[i] = i < input_size;
+    }
+    
+    values[bias_node] = (int16) (1 << value_shift);
+}
+
+template <class W>
+void ne_basic_quantized<W>::compute() {
+    uint64 size = values.size(), n = 0;
+    
+    const uint32* offset = offsets.data();
+    const uint32* source = sources.data();
+    const W* weight = weights.data();
+    
+    int16* value = values.data();
+    int64* sum = sums.data();
+    uint8* active = activated.data();
+    uint8* next = computed.data();
+    
+    if(forward) {
+        for(uint32 j : order) {
+            if(offset[j] == offset[j + 1]) continue;
+            
+            int64 s = 0;
+            uint8 c = 0;
+            
+            for(uint64 e = offset[j]; e != offset[j + 1]; ++e) {
+                if(active[source[e]]) {
+                    c = 1;
+                    s += (int64) value[source[e]] * weight[e];
+                }
+            }
+            
+            if(c)
+                value[j] = _activate(j, s);
+            
+            active[j] = c;
+        }
+        
+        return;
+    }
+    
+    while(n != activations) {
+        for(uint64 j = 0; j != size; ++j) {
+            int64 s = 0;
+            uint8 c = 0;
+            
+            for(uint64 e = offset[j]; e != offset[j + 1]; ++e) {
+                if(active[source[e]]) {
+                    c = 1;
+                    s += (int64) value[source[e]] * weight[e];
+                }
+            }
+            
+            sum[j] = s;
+            next[j] = c;
+        }
+        
+        for(uint64 j = 0; j != size; ++j) {
+            if(next[j])
+                value[j] = _activate((uint32) j, sum[j]);
+            
+            active[j] = next[j];
+        }
+        
+        ++n;
+    }
+}
+
+template <class W>
+void ne_basic_quantized<W>::compute(const float64* inputs, float64* outputs) {
+    uint64 inputs_size = input_size - 1;
+    
+    for(uint64 i = 0; i != inputs_size; ++i) {
+        values[i] = ne_fixed(inputs[i], value_shift);
+    }
+    
+    compute();
+    
+    for(uint64 i = 0; i != output_size; ++i) {
+        outputs[i] = ldexp((float64) values[input_size + i], -(int) value_shift);
+    }
+}
+
+template <class W>
+ne_quantization_report ne_basic_quantized<W>::report(const ne_genome* genome, const float64* samples, uint64 count) const {
+    ne_phenotype64 net(genome, sorted);
+    ne_basic_quantized<W> copy = *this;
+    
+    uint64 inputs_size = input_size - 1;
+    
+    std::vector<float64> outputs(output_size);
+    
+    ne_quantization_report result = { count, 0, 0.0, 0.0 };
+    
+    net.reset();
+    net.flush();
+    copy.reset();
+    copy.flush();
+    
+    for(uint64 k = 0; k != count; ++k) {
+        const float64* row = samples + k * inputs_size;
+        
+        std::copy(row, row + inputs_size, net.inputs());
+        net.compute();
+        copy.compute(row, outputs.data());
+        
+        for(uint64 i = 0; i != output_size; ++i) {
+            float64 d = fabs(outputs[i] - net.outputs()[i]);
+            
+            result.max_error = std::max(result.max_error, d);
+            result.mean_error += d;
+            ++result.outputs;
+        }
+    }
+    
+    if(result.outputs != 0)
+        result.mean_error /= result.outputs;
+    
+    return result;
+}
+
+template <class W>
+void ne_basic_quantized<W>::write(std::vector<uint8>& out) const {
+    uint64 size = values.size();
+    
+    uint64 header[ne_quantized_header] = {
+        ne_quantized_magic, ne_quantized_version, sizeof(W),
+        input_size, output_size, activations,
+        value_shift, sorted, forward,
+        size, weights.size()
+    };
+    
+    for(uint64 word : header) {
+        ne_put(out, word, 8);
+    }
+    
+    for(uint64 j = 0; j != size; ++j) {
+        ne_put(out, functions[j], 1);
+        ne_put(out, shifts[j], 1);
+        ne_put(out, offsets[j + 1], 4);
+    }
+    
+    for(uint32 j : order) {
+        ne_put(out, j, 4);
+    }
+    
+    for(uint64 e = 0; e != weights.size(); ++e) {
+        ne_put(out, sources[e], 4);
+        ne_put(out, (uint64) weights[e], sizeof(W));
+    }
+}
+
+template <class W>
+uint64 ne_basic_quantized<W>::read(const uint8* data, uint64 size) {
+    uint64 header[ne_quantized_header];
+    
+    if(size < sizeof(header))
+        return 0;
+    
+    const uint8* p = data;
+    
+    for(uint64& word : header) {
+        word = ne_get(p, 8);
+    }
+    
+    if(header[0] != ne_quantized_magic || header[1] != ne_quantized_version || header[2] != sizeof(W))
+        return 0;
+    
+    uint64 nodes = header[9], edges = header[10];
+    
+    if(nodes > 0xffffffff || edges > 0xffffffff || header[3] == 0 || header[3] + header[4] > nodes || header[6] > 14)
+        return 0;
+    
+    uint64 body = nodes * 6 + (header[8] ? nodes * 4 : 0) + edges * (4 + sizeof(W));
+    
+    if(size - sizeof(header) < body)
+        return 0;
+    
+    std::vector<uint8> f(nodes), h(nodes);
+    std::vector<uint32> o(1, 0), r, s(edges);
+    std::vector<W> w(edges);
+    
+    for(uint64 j = 0; j != nodes; ++j) {
+        f[j] = (uint8) ne_get(p, 1);
+        h[j] = (uint8) ne_get(p, 1);
+        o.push_back((uint32) ne_get(p, 4));
+        
+        if(f[j] >= ne_activation_count || h[j] > ne_weight_shift_limit || o[j + 1] < o[j] || o[j + 1] > edges)
+            return 0;
+    }
+    
+    if(o.back() != edges)
+        return 0;
+    
+    if(header[8]) {
+        for(uint64 k = 0; k != nodes; ++k) {
+            r.push_back((uint32) ne_get(p, 4));
+            
+            if(r.back() >= nodes)
+                return 0;
+        }
+    }
+    
+    for(uint64 e = 0; e != edges; ++e) {
+        s[e] = (uint32) ne_get(p, 4);
+        w[e] = (W) ne_get(p, sizeof(W));
+        
+        if(s[e] >= nodes)
+            return 0;
+    }
+    
+    input_size = header[3];
+    output_size = header[4];
+    activations = header[5];
+    value_shift = header[6];
+    sorted = header[7] != 0;
+    forward = header[8] != 0;
+    
+    bias_node = input_size - 1;
+    hidden_begin = input_size + output_size;
+    
+    functions.swap(f);
+    shifts.swap(h);
+    offsets.swap(o);
+    order.swap(r);
+    sources.swap(s);
+    weights.swap(w);
+    
+    values.assign(nodes, 0);
+    sums.assign(nodes, 0);
+    activated.assign(nodes, 0);
+    computed.assign(nodes, 0);
+    
+    return sizeof(header) + body;
+}
+
+template class ne_basic_quantized<int8>;
+template class ne_basic_quantized<int16>;
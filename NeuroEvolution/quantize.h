@@ -0,0 +1,155 @@
+//
+//  quantize.h
+//  NeuroEvolution
+//
+
+#ifndef ne_quantize_h
+#define ne_quantize_h
+
+#include "phenotype.h"
+
+/// How far a quantized network's outputs are from what the float64
+/// network computes on the same inputs.
+struct ne_quantization_report
+{
+    uint64 samples;
+    uint64 outputs;
+    
+    float64 max_error;
+    float64 mean_error;
+};
+
+/// A genome in fixed point for integer-only inference. Values are int16
+/// with `value_bits()` fraction bits and weights are W, int8 or int16,
+/// with as many fraction bits as the largest weight into their slot
+/// allows, so each slot keeps its own small weights. The value format is
+/// chosen per network by running the float64 network over calibration
+/// samples. Sums are accumulated exactly in int64
+/// and the sweeps are those of ne_phenotype, so the only error is the
+/// rounding of weights, values and activations. Values past the calibrated
+/// range saturate.
+///
+/// tanh, sigmoid and gaussian are read from shared tables of step 1/64 on
+/// [-16, 16] with linear interpolation; softsign, relu and identity are
+/// computed exactly.
+template <class W>
+class ne_basic_quantized
+{
+    
+public:
+    
+    ne_basic_quantized() {}
+    
+    ne_basic_quantized(const ne_genome* genome, const float64* samples, uint64 count, bool feed_forward = false) {
+        compile(genome, samples, count, feed_forward);
+    }
+    
+    /// `samples` holds `count` rows of `input_count()` inputs, which are fed
+    /// in order to the reset and flushed float64 network, as a task steps
+    /// it. The largest magnitude any node reaches sets the value format.
+    void compile(const ne_genome* genome, const float64* samples, uint64 count, bool feed_forward = false);
+    
+    /// Fixed point inputs and outputs, in the value format.
+    inline int16* inputs() {
+        return values.data();
+    }
+    
+    inline int16* outputs() {
+        return values.data() + input_size;
+    }
+    
+    inline uint64 node_count() const {
+        return values.size();
+    }
+    
+    inline uint64 edge_count() const {
+        return weights.size();
+    }
+    
+    inline uint64 input_count() const {
+        return input_size - 1;
+    }
+    
+    inline uint64 output_count() const {
+        return output_size;
+    }
+    
+    inline uint64 value_bits() const {
+        return value_shift;
+    }
+    
+    /// The fewest fraction bits the weights of any slot with edges get.
+    uint64 weight_bits() const;
+    
+    /// The bytes the network reads per step.
+    uint64 footprint() const;
+    
+    void reset();
+    
+    void flush();
+    
+    void compute();
+    
+    /// One step with float inputs and outputs, converted at the boundary.
+    void compute(const float64* inputs, float64* outputs);
+    
+    /// Steps a copy of this network and the float64 network of `genome`,
+    /// both reset and flushed, through `count` rows of `samples` and
+    /// compares every output.
+    ne_quantization_report report(const ne_genome* genome, const float64* samples, uint64 count) const;
+    
+    /// Binary form: a header of little-endian 64 bit words, then the slots,
+    /// the order and the edges in little-endian fields of their own width.
+    /// Values are not saved; a loaded network starts reset.
+    void write(std::vector<uint8>& out) const;
+    
+    /// Returns the number of bytes consumed, or 0 if the data is not a
+    /// quantized network of this weight type.
+    uint64 read(const uint8* data, uint64 size);
+    
+    uint64 activations;
+    
+private:
+    
+    int16 _activate(uint32 j, int64 sum) const;
+    
+    int16 _value(int64 x, uint64 shift) const;
+    
+    uint64 bias_node;
+    uint64 hidden_begin;
+    
+    uint64 input_size;
+    uint64 output_size;
+    
+    uint64 value_shift;
+    
+    bool sorted = false;
+    bool forward = false;
+    
+    std::vector<uint32> order;
+    
+    std::vector<int16> values;
+    std::vector<int64> sums;
+    
+    std::vector<uint8> activated;
+    std::vector<uint8> computed;
+    
+    std::vector<uint8> functions;
+    
+    /// The fraction bits of the weights into each slot.
+    std::vector<uint8> shifts;
+    
+    /// The edges of slot j are [offsets[j], offsets[j + 1]).
+    std::vector<uint32> offsets;
+    std::vector<uint32> sources;
+    std::vector<W> weights;
+};
+
+typedef ne_basic_quantized<int8> ne_quantized8;
+typedef ne_basic_quantized<int16> ne_quantized16;
+
+/// The largest calibration error at which an int8 network is kept; past
+/// it the int16 form is used instead. Outputs are on the order of 1.
+static const float64 ne_quantized8_error_limit = 0.05;
+
+#endif /* ne_quantize_h */
@@ -0,0 +1,233 @@
+//
+//  random.h
+//  NeuroEvolution
+//
+
+#ifndef ne_random_h
+#define ne_random_h
+
+#include "common.h"
+#include <atomic>
+#include <random>
+
+/// xoshiro256**. Streams are separated by hashing the stream number into
+/// the initial state, which is plenty for the few thousand streams a
+/// generation asks for.
+struct ne_xoshiro
+{
+    uint64 s[4];
+    
+    inline void seed(uint64 seed, uint64 stream) {
+        uint64 x = ne_mix(seed + ne_mix(stream));
+        
+        for(uint64 i = 0; i != 4; ++i) {
+            x += 0x9e3779b97f4a7c15;
+            s[i] = ne_mix(x);
+        }
+    }
+    
+    inline uint64 next() {
+        uint64 r = s[1] * 5;
+        r = ((r << 7) | (r >> 57)) * 9;
+        
+        uint64 t = s[1] << 17;
+        
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = (s[3] << 45) | (s[3] >> 19);
+        
+        return r;
+    }
+};
+
+/// Philox4x32-10, counter based. The seed is the key and the stream number
+/// fills the upper half of the counter, so streams never overlap.
+struct ne_philox
+{
+    uint32 key[2];
+    uint32 counter[4];
+    uint32 block[4];
+    
+    uint64 used;
+    
+    inline void seed(uint64 seed, uint64 stream) {
+        key[0] = (uint32) seed;
+        key[1] = (uint32) (seed >> 32);
+        
+        counter[0] = 0;
+        counter[1] = 0;
+        counter[2] = (uint32) stream;
+        counter[3] = (uint32) (stream >> 32);
+        
+        used = 4;
+    }
+    
+    inline uint64 next() {
+        if(used == 4) {
+            _generate();
+            used = 0;
+        }
+        
+        uint64 r = block[used] | ((uint64) block[used + 1] << 32);
+        used += 2;
+        
+        return r;
+    }
+    
+    inline void _generate() {
+        uint32 x[4] = { counter[0], counter[1], counter[2], counter[3] };
+        uint32 k[2] = { key[0], key[1] };
+        
+        for(uint64 round = 0; round != 10; ++round) {
+            uint64 p0 = (uint64) 0xd2511f53 * x[0];
+            uint64 p1 = (uint64) 0xcd9e8d57 * x[2];
+            
+            uint32 y[4] = {
+                (uint32) (p1 >> 32) ^ x[1] ^ k[0],
+                (uint32) p1,
+                (uint32) (p0 >> 32) ^ x[3] ^ k[1],
+                (uint32) p0
+            };
+            
+            x[0] = y[0];
+            x[1] = y[1];
+            x[2] = y[2];
+            x[3] = y[3];
+            
+            k[0] += 0x9e3779b9;
+            k[1] += 0xbb67ae85;
+        }
+        
+        block[0] = x[0];
+        block[1] = x[1];
+        block[2] = x[2];
+        block[3] = x[3];
+        
+        if(++counter[0] == 0)
+            ++counter[1];
+    }
+};
+
+/// The engine every stream uses; define NE_PHILOX to switch to Philox.
+#if defined(NE_PHILOX)
+typedef ne_philox ne_engine;
+#else
+typedef ne_xoshiro ne_engine;
+#endif
+
+/// A random stream with its own gaussian cache. While one is installed as
+/// the calling thread's stream, every random draw below comes from it;
+/// otherwise draws come from the thread's default stream.
+struct ne_rng
+{
+    ne_engine engine;
+    
+    bool computed;
+    float64 value;
+    
+    inline void seed(uint64 seed, uint64 stream = 0) {
+        engine.seed(seed, stream);
+        computed = false;
+    }
+    
+    inline uint64 next() {
+        return engine.next();
+    }
+};
+
+inline std::atomic<uint64>& ne_seed_state() {
+    static std::atomic<uint64> seed(((uint64) std::random_device()() << 32) | std::random_device()());
+    return seed;
+}
+
+inline std::atomic<uint64>& ne_thread_count() {
+    static std::atomic<uint64> count(0);
+    return count;
+}
+
+/// Sets the seed the default streams of threads started afterwards use;
+/// each thread takes the next stream number of that seed. Draws that need
+/// to match across thread counts should run under an explicit stream.
+inline void ne_seed(uint64 seed) {
+    ne_seed_state() = seed;
+    ne_thread_count() = 0;
+}
+
+inline ne_rng& ne_thread_rng() {
+    static thread_local bool seeded = false;
+    static thread_local ne_rng rng;
+    
+    if(!seeded) {
+        rng.seed(ne_seed_state(), ne_thread_count()++);
+        seeded = true;
+    }
+    
+    return rng;
+}
+
+inline ne_rng*& ne_stream() {
+    static thread_local ne_rng* stream = nullptr;
+    return stream;
+}
+
+inline ne_rng& ne_current() {
+    ne_rng* rng = ne_stream();
+    return rng != nullptr ? *rng : ne_thread_rng();
+}
+
+struct ne_stream_scope
+{
+    ne_rng* previous;
+    
+    ne_stream_scope(ne_rng* rng) : previous(ne_stream()) {
+        ne_stream() = rng;
+    }
+    
+    ~ne_stream_scope() {
+        ne_stream() = previous;
+    }
+};
+
+inline uint32 rand32() {
+    return (uint32) (ne_current().next() >> 32);
+}
+
+inline uint64 rand64() {
+    return ne_current().next();
+}
+
+inline float64 random(float64 a, float64 b) {
+    return (rand64() / (float64) (0xffffffffffffffff)) * (b - a) + a;
+}
+
+inline uint64 random(uint64 a, uint64 b) {
+    return random(0.0, 1.0) * (b - a) + a;
+}
+
+inline float64 gaussian_random() {
+    ne_rng& rng = ne_current();
+    
+    if(rng.computed) {
+        rng.computed = false;
+        return rng.value;
+    }else{
+        float64 a, b, r, q;
+        
+        do {
+            a = random(-1.0, 1.0);
+            b = random(-1.0, 1.0);
+            r = a * a + b * b;
+        }  while (r >= 1.0 || r == 0.0);
+        
+        q = sqrt(-2.0 * log(r) / r);
+        
+        rng.computed = true;
+        rng.value = a * q;
+        return b * q;
+    }
+}
+
+#endif /* ne_random_h */
@@ -0,0 +1,389 @@
+//
+//  simd.h
+//  NeuroEvolution
+//
+
+#ifndef ne_simd_h
+#define ne_simd_h
+
+#include "common.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/// Thin wrappers over the widest vector unit the target was compiled for.
+/// ne_scalar has the same interface with a width of one, so kernels are
+/// written once and their tails give the same results as their bodies.
+struct ne_scalar
+{
+    typedef float64 type;
+    
+    static const uint64 width = 1;
+    
+    static inline type load(const float64* p) { return *p; }
+    static inline void store(float64* p, type x) { *p = x; }
+    static inline type set1(float64 x) { return x; }
+    
+    static inline type add(type a, type b) { return a + b; }
+    static inline type sub(type a, type b) { return a - b; }
+    static inline type mul(type a, type b) { return a * b; }
+    static inline type div(type a, type b) { return a / b; }
+    
+    static inline type abs(type x) { return fabs(x); }
+    static inline type max(type a, type b) { return a > b ? a : b; }
+    static inline type min(type a, type b) { return a < b ? a : b; }
+    static inline type copysign(type a, type b) { return std::copysign(a, b); }
+    
+    static inline type round(type x) {
+        const float64 magic = 6755399441055744.0;
+        return (x + magic) - magic;
+    }
+    
+    static inline type pow2(type k) {
+        return ldexp(1.0, (int) k);
+    }
+    
+    static constexpr float64 exp_min = -708.0;
+    static constexpr float64 exp_max = 709.0;
+};
+
+#if defined(__AVX2__)
+
+struct ne_vector
+{
+    typedef __m256d type;
+    
+    static const uint64 width = 4;
+    
+    static inline type load(const float64* p) { return _mm256_loadu_pd(p); }
+    static inline void store(float64* p, type x) { _mm256_storeu_pd(p, x); }
+    static inline type set1(float64 x) { return _mm256_set1_pd(x); }
+    
+    static inline type add(type a, type b) { return _mm256_add_pd(a, b); }
+    static inline type sub(type a, type b) { return _mm256_sub_pd(a, b); }
+    static inline type mul(type a, type b) { return _mm256_mul_pd(a, b); }
+    static inline type div(type a, type b) { return _mm256_div_pd(a, b); }
+    
+    static inline type abs(type x) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x); }
+    static inline type max(type a, type b) { return _mm256_max_pd(a, b); }
+    static inline type min(type a, type b) { return _mm256_min_pd(a, b); }
+    
+    static inline type copysign(type a, type b) {
+        type sign = _mm256_set1_pd(-0.0);
+        return _mm256_or_pd(_mm256_andnot_pd(sign, a), _mm256_and_pd(sign, b));
+    }
+    
+    static inline type round(type x) {
+        type magic = _mm256_set1_pd(6755399441055744.0);
+        return _mm256_sub_pd(_mm256_add_pd(x, magic), magic);
+    }
+    
+    static inline type pow2(type k) {
+        __m256i bits = _mm256_castpd_si256(_mm256_add_pd(k, _mm256_set1_pd(6755399441055744.0)));
+        bits = _mm256_add_epi64(bits, _mm256_set1_epi64x(1023));
+        return _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52));
+    }
+    
+    static constexpr float64 exp_min = -708.0;
+    static constexpr float64 exp_max = 709.0;
+};
+
+#elif defined(__SSE2__)
+
+struct ne_vector
+{
+    typedef __m128d type;
+    
+    static const uint64 width = 2;
+    
+    static inline type load(const float64* p) { return _mm_loadu_pd(p); }
+    static inline void store(float64* p, type x) { _mm_storeu_pd(p, x); }
+    static inline type set1(float64 x) { return _mm_set1_pd(x); }
+    
+    static inline type add(type a, type b) { return _mm_add_pd(a, b); }
+    static inline type sub(type a, type b) { return _mm_sub_pd(a, b); }
+    static inline type mul(type a, type b) { return _mm_mul_pd(a, b); }
+    static inline type div(type a, type b) { return _mm_div_pd(a, b); }
+    
+    static inline type abs(type x) { return _mm_andnot_pd(_mm_set1_pd(-0.0), x); }
+    static inline type max(type a, type b) { return _mm_max_pd(a, b); }
+    static inline type min(type a, type b) { return _mm_min_pd(a, b); }
+    
+    static inline type copysign(type a, type b) {
+        type sign = _mm_set1_pd(-0.0);
+        return _mm_or_pd(_mm_andnot_pd(sign, a), _mm_and_pd(sign, b));
+    }
+    
+    static inline type round(type x) {
+        type magic = _mm_set1_pd(6755399441055744.0);
+        return _mm_sub_pd(_mm_add_pd(x, magic), magic);
+    }
+    
+    static inline type pow2(type k) {
+        __m128i bits = _mm_castpd_si128(_mm_add_pd(k, _mm_set1_pd(6755399441055744.0)));
+        bits = _mm_add_epi64(bits, _mm_set1_epi64x(1023));
+        return _mm_castsi128_pd(_mm_slli_epi64(bits, 52));
+    }
+    
+    static constexpr float64 exp_min = -708.0;
+    static constexpr float64 exp_max = 709.0;
+};
+
+#else
+
+typedef ne_scalar ne_vector;
+
+#endif
+
+/// The same interface over float32, for networks evaluated in single
+/// precision. Twice as many lanes fit in a register.
+struct ne_scalar32
+{
+    typedef float32 type;
+    
+    static const uint64 width = 1;
+    
+    static inline type load(const float32* p) { return *p; }
+    static inline void store(float32* p, type x) { *p = x; }
+    static inline type set1(float64 x) { return (float32) x; }
+    
+    static inline type add(type a, type b) { return a + b; }
+    static inline type sub(type a, type b) { return a - b; }
+    static inline type mul(type a, type b) { return a * b; }
+    static inline type div(type a, type b) { return a / b; }
+    
+    static inline type abs(type x) { return fabsf(x); }
+    static inline type max(type a, type b) { return a > b ? a : b; }
+    static inline type min(type a, type b) { return a < b ? a : b; }
+    static inline type copysign(type a, type b) { return std::copysign(a, b); }
+    
+    static inline type round(type x) {
+        const float32 magic = 12582912.0f;
+        return (x + magic) - magic;
+    }
+    
+    static inline type pow2(type k) {
+        return ldexpf(1.0f, (int) k);
+    }
+    
+    static constexpr float64 exp_min = -87.0;
+    static constexpr float64 exp_max = 88.0;
+};
+
+#if defined(__AVX2__)
+
+struct ne_vector32
+{
+    typedef __m256 type;
+    
+    static const uint64 width = 8;
+    
+    static inline type load(const float32* p) { return _mm256_loadu_ps(p); }
+    static inline void store(float32* p, type x) { _mm256_storeu_ps(p, x); }
+    static inline type set1(float64 x) { return _mm256_set1_ps((float32) x); }
+    
+    static inline type add(type a, type b) { return _mm256_add_ps(a, b); }
+    static inline type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+    static inline type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+    static inline type div(type a, type b) { return _mm256_div_ps(a, b); }
+    
+    static inline type abs(type x) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x); }
+    static inline type max(type a, type b) { return _mm256_max_ps(a, b); }
+    static inline type min(type a, type b) { return _mm256_min_ps(a, b); }
+    
+    static inline type copysign(type a, type b) {
+        type sign = _mm256_set1_ps(-0.0f);
+        return _mm256_or_ps(_mm256_andnot_ps(sign, a), _mm256_and_ps(sign, b));
+    }
+    
+    static inline type round(type x) {
+        type magic = _mm256_set1_ps(12582912.0f);
+        return _mm256_sub_ps(_mm256_add_ps(x, magic), magic);
+    }
+    
+    static inline type pow2(type k) {
+        __m256i bits = _mm256_castps_si256(_mm256_add_ps(k, _mm256_set1_ps(12582912.0f)));
+        bits = _mm256_add_epi32(bits, _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(bits, 23));
+    }
+    
+    static constexpr float64 exp_min = -87.0;
+    static constexpr float64 exp_max = 88.0;
+};
+
+#elif defined(__SSE2__)
+
+struct ne_vector32
+{
+    typedef __m128 type;
+    
+    static const uint64 width = 4;
+    
+    static inline type load(const float32* p) { return _mm_loadu_ps(p); }
+    static inline void store(float32* p, type x) { _mm_storeu_ps(p, x); }
+    static inline type set1(float64 x) { return _mm_set1_ps((float32) x); }
+    
+    static inline type add(type a, type b) { return _mm_add_ps(a, b); }
+    static inline type sub(type a, type b) { return _mm_sub_ps(a, b); }
+    static inline type mul(type a, type b) { return _mm_mul_ps(a, b); }
+    static inline type div(type a, type b) { return _mm_div_ps(a, b); }
+    
+    static inline type abs(type x) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), x); }
+    static inline type max(type a, type b) { return _mm_max_ps(a, b); }
+    static inline type min(type a, type b) { return _mm_min_ps(a, b); }
+    
+    static inline type copysign(type a, type b) {
+        type sign = _mm_set1_ps(-0.0f);
+        return _mm_or_ps(_mm_andnot_ps(sign, a), _mm_and_ps(sign, b));
+    }
+    
+    static inline type round(type x) {
+        type magic = _mm_set1_ps(12582912.0f);
+        return _mm_sub_ps(_mm_add_ps(x, magic), magic);
+    }
+    
+    static inline type pow2(type k) {
+        __m128i bits = _mm_castps_si128(_mm_add_ps(k, _mm_set1_ps(12582912.0f)));
+        bits = _mm_add_epi32(bits, _mm_set1_epi32(127));
+        return _mm_castsi128_ps(_mm_slli_epi32(bits, 23));
+    }
+    
+    static constexpr float64 exp_min = -87.0;
+    static constexpr float64 exp_max = 88.0;
+};
+
+#else
+
+typedef ne_scalar32 ne_vector32;
+
+#endif
+
+/// The scalar and vector wrappers for a value type.
+template <class T>
+struct ne_simd;
+
+template <>
+struct ne_simd<float64>
+{
+    typedef ne_scalar scalar;
+    typedef ne_vector vector;
+};
+
+template <>
+struct ne_simd<float32>
+{
+    typedef ne_scalar32 scalar;
+    typedef ne_vector32 vector;
+};
+
+/// exp(x) by Cody-Waite reduction to |r| <= ln(2) / 2 and a degree 12
+/// Taylor polynomial. The truncation error is below 2e-16 relative, and
+/// the result stays within 4 ulp of the correctly rounded value for x in
+/// [-708, 709]; inputs outside that range are clamped to it. In single
+/// precision the range is [-87, 88], so 2^k stays a normal float.
+template <class S>
+inline typename S::type ne_exp(typename S::type x) {
+    typedef typename S::type type;
+    
+    x = S::min(S::max(x, S::set1(S::exp_min)), S::set1(S::exp_max));
+    
+    type k = S::round(S::mul(x, S::set1(1.4426950408889634)));
+    type r = S::sub(S::sub(x, S::mul(k, S::set1(6.93145751953125e-1))), S::mul(k, S::set1(1.42860682030941723212e-6)));
+    
+    type p = S::set1(1.0 / 479001600.0);
+    p = S::add(S::mul(p, r), S::set1(1.0 / 39916800.0));
+    p = S::add(S::mul(p, r), S::set1(1.0 / 3628800.0));
+    p = S::add(S::mul(p, r), S::set1(1.0 / 362880.0));
+    p = S::add(S::mul(p, r), S::set1(1.0 / 40320.0));
+    p = S::add(S::mul(p, r), S::set1(1.0 / 5040.0));
+    p = S::add(S::mul(p, r), S::set1(1.0 / 720.0));
+    p = S::add(S::mul(p, r), S::set1(1.0 / 120.0));
+    p = S::add(S::mul(p, r), S::set1(1.0 / 24.0));
+    p = S::add(S::mul(p, r), S::set1(1.0 / 6.0));
+    p = S::add(S::mul(p, r), S::set1(0.5));
+    p = S::add(S::mul(p, r), S::set1(1.0));
+    p = S::add(S::mul(p, r), S::set1(1.0));
+    
+    return S::mul(p, S::pow2(k));
+}
+
+/// sin(x) and cos(x) by reduction to |r| <= pi / 4 with a three part
+/// pi / 2, then Taylor polynomials of degree 17 and 16 and a quadrant swap
+/// done with exact multiplications by 0 and 1. For |x| below 2^20 the
+/// absolute error is below 2e-16, which is within 2 ulp wherever the
+/// result is not close to zero; near the zeros of sin and cos the relative
+/// error is larger, since the reduction is not exact. Larger x lose
+/// accuracy in the reduction.
+template <class S>
+inline void ne_sincos(typename S::type x, typename S::type* sin, typename S::type* cos) {
+    typedef typename S::type type;
+    
+    type k = S::round(S::mul(x, S::set1(6.36619772367581382433e-1)));
+    
+    type r = S::sub(x, S::mul(k, S::set1(1.57079632673412561417e+00)));
+    r = S::sub(r, S::mul(k, S::set1(6.07710050630396597660e-11)));
+    r = S::sub(r, S::mul(k, S::set1(2.02226624871116645580e-21)));
+    
+    type r2 = S::mul(r, r);
+    
+    type p = S::set1(1.0 / 355687428096000.0);
+    p = S::sub(S::set1(1.0 / 1307674368000.0), S::mul(p, r2));
+    p = S::sub(S::set1(1.0 / 6227020800.0), S::mul(p, r2));
+    p = S::sub(S::set1(1.0 / 39916800.0), S::mul(p, r2));
+    p = S::sub(S::set1(1.0 / 362880.0), S::mul(p, r2));
+    p = S::sub(S::set1(1.0 / 5040.0), S::mul(p, r2));
+    p = S::sub(S::set1(1.0 / 120.0), S::mul(p, r2));
+    p = S::sub(S::set1(1.0 / 6.0), S::mul(p, r2));
+    
+    type s = S::sub(r, S::mul(S::mul(p, r2), r));
+    
+    type q = S::set1(1.0 / 20922789888000.0);
+    q = S::sub(S::set1(1.0 / 87178291200.0), S::mul(q, r2));
+    q = S::sub(S::set1(1.0 / 479001600.0), S::mul(q, r2));
+    q = S::sub(S::set1(1.0 / 3628800.0), S::mul(q, r2));
+    q = S::sub(S::set1(1.0 / 40320.0), S::mul(q, r2));
+    q = S::sub(S::set1(1.0 / 720.0), S::mul(q, r2));
+    q = S::sub(S::set1(1.0 / 24.0), S::mul(q, r2));
+    q = S::sub(S::set1(0.5), S::mul(q, r2));
+    
+    type c = S::sub(S::set1(1.0), S::mul(q, r2));
+    
+    /// The quadrant m = k mod 4 as its two bits: odd swaps sin and cos,
+    /// high negates sin, and odd xor high negates cos. None of the values
+    /// rounded here are halfway between integers.
+    type m = S::sub(k, S::mul(S::set1(4.0), S::round(S::sub(S::mul(k, S::set1(0.25)), S::set1(0.375)))));
+    type high = S::round(S::sub(S::mul(m, S::set1(0.5)), S::set1(0.25)));
+    type odd = S::sub(m, S::mul(S::set1(2.0), high));
+    type even = S::sub(S::set1(1.0), odd);
+    
+    type flip = S::sub(S::add(odd, high), S::mul(S::set1(2.0), S::mul(odd, high)));
+    
+    *sin = S::mul(S::add(S::mul(s, even), S::mul(c, odd)), S::sub(S::set1(1.0), S::mul(S::set1(2.0), high)));
+    *cos = S::mul(S::add(S::mul(c, even), S::mul(s, odd)), S::sub(S::set1(1.0), S::mul(S::set1(2.0), flip)));
+}
+
+/// sin and cos as the tasks take them. With NE_FAST_ACTIVATIONS defined
+/// this is ne_sincos; otherwise every lane calls libm, so results match
+/// plain sin and cos and only the arithmetic around them is vectorized.
+/// Either way a lane gets the same result at every width.
+template <class S>
+inline void ne_trig(typename S::type x, typename S::type* sin, typename S::type* cos) {
+#ifdef NE_FAST_ACTIVATIONS
+    ne_sincos<S>(x, sin, cos);
+#else
+    float64 a[S::width], s[S::width], c[S::width];
+    
+    S::store(a, x);
+    
+    for(uint64 i = 0; i != S::width; ++i) {
+        s[i] = ::sin(a[i]);
+        c[i] = ::cos(a[i]);
+    }
+    
+    *sin = S::load(s);
+    *cos = S::load(c);
+#endif
+}
+
+#endif /* ne_simd_h */
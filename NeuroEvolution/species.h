@@ -16,6 +16,7 @@ struct ne_species
 {
     ne_species() {
         max_fitness = -std::numeric_limits<double>::max();
+        fitness_sum = 0.0;
         time_since_improvement = 0;
     }
     
@@ -24,6 +25,10 @@ struct ne_species
     float64 avg_fitness;
     float64 max_fitness;
     
+    /// The genomes' fitness floored at 0, summed as ne_population::evolve
+    /// adds and removes them.
+    float64 fitness_sum;
+    
     uint64 time_since_improvement;
     uint64 parents;
     uint64 offsprings;
@@ -0,0 +1,98 @@
+//
+//  table.h
+//  NeuroEvolution
+//
+
+#ifndef ne_table_h
+#define ne_table_h
+
+#include "common.h"
+#include <algorithm>
+#include <vector>
+
+/// A flat open addressing set of pointers with linear probing, looked up
+/// by the key K extracts from them. Pointers are stored in one array, so a
+/// lookup touches a single cache line in the common case.
+template <class T, class K>
+class ne_table
+{
+    
+public:
+    
+    typedef typename K::key_type key_type;
+    
+    inline uint64 size() const {
+        return count;
+    }
+    
+    inline T* find(const key_type& key) const {
+        if(count == 0) return nullptr;
+        
+        uint64 h = K::hash(key) & mask;
+        
+        while(slots[h] != nullptr) {
+            if(K::equal(slots[h], key))
+                return slots[h];
+            
+            h = (h + 1) & mask;
+        }
+        
+        return nullptr;
+    }
+    
+    inline void insert(T* x) {
+        if((count + 1) * 2 > slots.size())
+            _rehash(slots.empty() ? 16 : slots.size() * 2);
+        
+        _place(x);
+    }
+    
+    void reserve(uint64 n) {
+        uint64 capacity = 16;
+        
+        while(capacity < n * 2)
+            capacity <<= 1;
+        
+        if(capacity > slots.size())
+            _rehash(capacity);
+    }
+    
+    void clear() {
+        if(count != 0)
+            std::fill(slots.begin(), slots.end(), nullptr);
+        
+        count = 0;
+    }
+    
+private:
+    
+    inline void _place(T* x) {
+        uint64 h = K::hash(K::key(x)) & mask;
+        
+        while(slots[h] != nullptr)
+            h = (h + 1) & mask;
+        
+        slots[h] = x;
+        ++count;
+    }
+    
+    void _rehash(uint64 capacity) {
+        std::vector<T*> old(capacity, nullptr);
+        old.swap(slots);
+        
+        mask = capacity - 1;
+        count = 0;
+        
+        for(T* x : old) {
+            if(x != nullptr)
+                _place(x);
+        }
+    }
+    
+    std::vector<T*> slots;
+    
+    uint64 mask = 0;
+    uint64 count = 0;
+};
+
+#endif /* ne_table_h */
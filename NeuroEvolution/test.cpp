@@ -0,0 +1,884 @@
+//
+//  test.cpp
+//  NeuroEvolution
+//
+
+#include "population.h"
+#include "phenotype.h"
+#include "group.h"
+#include "quantize.h"
+#include "codegen.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+/// Checks that the fast paths compute what the reference paths do.
+/// Usage: tests <params file> [filter]. Exits nonzero if a check fails.
+
+static const uint64 ne_inputs = 4;
+static const uint64 ne_outputs = 2;
+
+/// Genomes grown per case, and the steps each network is run for.
+static const uint64 ne_trials = 16;
+static const uint64 ne_steps = 24;
+
+struct ne_case
+{
+    const char* name;
+    void (*run)();
+};
+
+ne_params params;
+
+std::string filter;
+
+static uint64 checks = 0;
+static uint64 failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    ++checks;
+    
+    if(!ok) {
+        ++failures;
+        std::cerr << "FAIL " << what << std::endl;
+    }
+}
+
+/// Compares bit patterns, so that NaNs in the same place agree.
+static bool same(float64 a, float64 b) {
+    return ne_bits(a) == ne_bits(b);
+}
+
+/// Grows a minimal genome by adding nodes and genes until it has `genes`
+/// genes, with random activation functions on the hidden nodes.
+static void grow(ne_genome* genome, uint64 genes, ne_innovation_set* set, uint64* innovation, uint64* node_ids) {
+    for(uint64 n = 0; genome->gene_count() < genes && n != genes * 8; ++n) {
+        if(random(0.0, 1.0) < 0.25)
+            genome->mutate_add_node(set, innovation, node_ids, params);
+        else
+            genome->mutate_add_gene(set, innovation, params);
+        
+        if(random(0.0, 1.0) < 0.25)
+            genome->mutate_function(params);
+    }
+    
+    genome->mutate_weights(params);
+}
+
+/// A genome of about `genes` genes and `activations` sweeps, drawn from
+/// stream `trial`.
+static void make(ne_genome* genome, uint64 genes, uint64 activations, uint64 trial) {
+    ne_rng rng;
+    rng.seed(params.seed, trial);
+    ne_stream_scope scope(&rng);
+    
+    ne_innovation_set set;
+    uint64 innovation = 0;
+    uint64 node_ids = ne_inputs + 1 + ne_outputs;
+    
+    genome->reset(ne_inputs, ne_outputs, &set, &innovation);
+    grow(genome, genes, &set, &innovation, &node_ids);
+    
+    genome->activations = activations;
+}
+
+/// Steps a genome and its compiled network through the same random
+/// inputs and tells whether their outputs agree bit for bit. With
+/// `forward` set both make the single pass.
+static bool matches(ne_genome& genome, bool forward, uint64 trial) {
+    ne_phenotype64 net(&genome, forward);
+    
+    net.reset();
+    net.flush();
+    genome.flush();
+    
+    ne_rng rng;
+    rng.seed(params.seed, ne_trials + trial);
+    ne_stream_scope scope(&rng);
+    
+    bool equal = true;
+    
+    for(uint64 step = 0; step != ne_steps; ++step) {
+        for(uint64 i = 0; i != ne_inputs; ++i) {
+            float64 x = random(-2.0, 2.0);
+            
+            genome.inputs()[i]->value = x;
+            net.inputs()[i] = x;
+        }
+        
+        if(forward)
+            genome.compute_forward();
+        else
+            genome.compute();
+        
+        net.compute();
+        
+        for(uint64 o = 0; o != ne_outputs; ++o) {
+            equal = equal && same(genome.outputs()[o]->value, net.outputs()[o]);
+        }
+    }
+    
+    return equal;
+}
+
+static void test_phenotype() {
+    for(uint64 trial = 0; trial != ne_trials; ++trial) {
+        ne_genome genome;
+        make(&genome, 8 + trial * 8, 1 + trial % 4, trial);
+        
+        check(matches(genome, false, trial), "phenotype matches genome, trial " + std::to_string(trial));
+    }
+}
+
+static void test_feed_forward() {
+    uint64 saved = params.feed_forward;
+    params.feed_forward = 1;
+    
+    for(uint64 trial = 0; trial != ne_trials; ++trial) {
+        ne_genome genome;
+        make(&genome, 8 + trial * 8, 1, trial);
+        
+        std::string name = ", trial " + std::to_string(trial);
+        
+        check(genome.acyclic(), "feed-forward mutations keep the genome acyclic" + name);
+        check(matches(genome, true, trial), "single pass matches compute_forward" + name);
+    }
+    
+    params.feed_forward = saved;
+}
+
+/// Steps two networks through the same random inputs and tells whether
+/// their outputs agree bit for bit.
+template <class A, class B>
+static bool agree(A& a, B& b, uint64 trial) {
+    ne_rng rng;
+    rng.seed(params.seed, ne_trials + trial);
+    ne_stream_scope scope(&rng);
+    
+    a.reset();
+    a.flush();
+    b.reset();
+    b.flush();
+    
+    bool equal = true;
+    
+    for(uint64 step = 0; step != ne_steps; ++step) {
+        for(uint64 i = 0; i != ne_inputs; ++i) {
+            float64 x = random(-2.0, 2.0);
+            
+            a.inputs()[i] = x;
+            b.inputs()[i] = x;
+        }
+        
+        a.compute();
+        b.compute();
+        
+        for(uint64 o = 0; o != ne_outputs; ++o) {
+            equal = equal && same(a.outputs()[o], b.outputs()[o]);
+        }
+    }
+    
+    return equal;
+}
+
+static void test_genome_io() {
+    for(uint64 trial = 0; trial != ne_trials; ++trial) {
+        ne_genome genome, loaded;
+        make(&genome, 8 + trial * 8, 1 + trial % 4, trial);
+        
+        genome.fitness = random(0.0, 1.0);
+        
+        std::vector<uint8> bytes, again;
+        genome.write(bytes);
+        
+        std::string name = ", trial " + std::to_string(trial);
+        
+        bool read = loaded.read(bytes.data(), bytes.size()) == bytes.size();
+        check(read, "genome reads back" + name);
+        
+        if(!read) continue;
+        
+        loaded.write(again);
+        
+        check(again == bytes, "genome writes back the same bytes" + name);
+        check(same(loaded.fitness, genome.fitness), "genome keeps its fitness" + name);
+        
+        ne_phenotype64 a(&genome), b(&loaded);
+        check(agree(a, b, trial), "loaded genome computes the same" + name);
+        
+        check(loaded.read(bytes.data(), bytes.size() - 1) == 0, "truncated genome is refused" + name);
+    }
+}
+
+static void test_incremental() {
+    /// Numbered past anything make() hands out.
+    ne_innovation_set set;
+    uint64 innovation = (uint64) 1 << 32;
+    uint64 node_ids = (uint64) 1 << 32;
+    
+    for(uint64 trial = 0; trial != ne_trials; ++trial) {
+        ne_genome genome;
+        make(&genome, 8 + trial * 8, 1 + trial % 3, trial);
+        
+        genome.network();
+        
+        ne_rng rng;
+        rng.seed(params.seed, 2 * ne_trials + trial);
+        ne_stream_scope scope(&rng);
+        
+        bool equal = true;
+        
+        /// Each baby is cloned from the last, with its network.
+        for(uint64 n = 0; n != 32; ++n) {
+            ne_genome baby(genome);
+            
+            float64 r = random(0.0, 1.0);
+            
+            if(r < 0.3)
+                baby.mutate_add_node(&set, &innovation, &node_ids, params);
+            else if(r < 0.6)
+                baby.mutate_add_gene(&set, &innovation, params);
+            else if(r < 0.8)
+                baby.mutate_weights(params);
+            else
+                baby.mutate_function(params);
+            
+            ne_phenotype fresh(&baby);
+            
+            equal = equal && agree(*baby.network(), fresh, trial);
+            
+            genome = baby;
+        }
+        
+        check(equal, "network kept through mutations matches a fresh compile, trial " + std::to_string(trial));
+    }
+}
+
+static void test_group() {
+    for(uint64 trial = 0; trial != ne_trials; ++trial) {
+        ne_genome genome;
+        make(&genome, 8 + trial * 8, 1 + trial % 4, trial);
+        
+        /// Lanes that differ only in their weights.
+        uint64 count = 1 + trial * 3;
+        
+        std::vector<ne_genome> lanes(count, genome);
+        std::vector<ne_genome*> pointers;
+        
+        for(ne_genome& lane : lanes) {
+            lane.mutate_weights(params);
+            pointers.push_back(&lane);
+        }
+        
+        ne_group64 group(pointers.data(), count);
+        std::vector<ne_phenotype64> nets;
+        
+        for(ne_genome& lane : lanes) {
+            nets.emplace_back(&lane);
+            nets.back().reset();
+            nets.back().flush();
+        }
+        
+        group.reset();
+        group.flush();
+        
+        ne_rng rng;
+        rng.seed(params.seed, ne_trials + trial);
+        ne_stream_scope scope(&rng);
+        
+        std::vector<float64> inputs(count * ne_inputs), outputs(count * ne_outputs);
+        
+        bool equal = true;
+        
+        for(uint64 step = 0; step != ne_steps; ++step) {
+            for(float64& x : inputs) {
+                x = random(-2.0, 2.0);
+            }
+            
+            group.compute(inputs.data(), outputs.data());
+            
+            for(uint64 k = 0; k != count; ++k) {
+                std::copy(inputs.begin() + k * ne_inputs, inputs.begin() + (k + 1) * ne_inputs, nets[k].inputs());
+                nets[k].compute();
+                
+                for(uint64 o = 0; o != ne_outputs; ++o) {
+                    equal = equal && same(outputs[k * ne_outputs + o], nets[k].outputs()[o]);
+                }
+            }
+        }
+        
+        check(equal, "group lanes match their phenotypes, trial " + std::to_string(trial));
+    }
+}
+
+/// A stochastic task: the network's response to a random input plus noise,
+/// both drawn from the genome's stream.
+static float64 noisy(ne_genome* genome) {
+    ne_phenotype& net = *genome->network();
+    
+    net.reset();
+    net.flush();
+    
+    for(uint64 i = 0; i != ne_inputs; ++i) {
+        net.inputs()[i] = random(-1.0, 1.0);
+    }
+    
+    net.compute();
+    
+    return fabs(net.outputs()[0]) + random(0.0, 0.1);
+}
+
+/// Every genome's signature and fitness, in population order.
+static void fingerprint(ne_population& population, std::vector<uint64>& out) {
+    std::vector<uint64> words;
+    
+    out.clear();
+    
+    for(const ne_genome* genome : population.genomes) {
+        genome->signature(words);
+        
+        out.push_back(ne_bits(genome->fitness));
+        out.insert(out.end(), words.begin(), words.end());
+    }
+}
+
+static void score(ne_population& population) {
+    population.evaluate([](ne_genome* genome, uint64) {
+        return noisy(genome);
+    });
+}
+
+/// Evolves `population` for `generations` on the noisy task.
+static void advance(ne_population& population, uint64 generations) {
+    for(uint64 n = 0; n != generations; ++n) {
+        score(population);
+        
+        population.select();
+        population.reproduce();
+    }
+}
+
+static void test_threads() {
+    ne_params p = params;
+    p.population = 64;
+    
+    std::vector<uint64> expected, found;
+    
+    for(uint64 threads : { 1, 2, 4 }) {
+        p.threads = threads;
+        
+        ne_population population;
+        population.reset(p, ne_inputs, ne_outputs);
+        
+        advance(population, 8);
+        score(population);
+        
+        fingerprint(population, found);
+        
+        if(threads == 1)
+            expected.swap(found);
+        else
+            check(found == expected, "evolution on " + std::to_string(threads) + " threads matches 1");
+    }
+}
+
+/// evaluate_groups hands each genome the stream evaluate() would.
+static void test_evaluate_groups() {
+    ne_params p = params;
+    p.population = 64;
+    
+    ne_population a, b;
+    a.reset(p, ne_inputs, ne_outputs);
+    b.reset(p, ne_inputs, ne_outputs);
+    
+    advance(a, 4);
+    advance(b, 4);
+    
+    score(a);
+    
+    b.evaluate_groups([](ne_genome* const* genomes, ne_rng* streams, uint64 count, uint64) {
+        for(uint64 k = 0; k != count; ++k) {
+            ne_stream_scope scope(streams + k);
+            genomes[k]->fitness = noisy(genomes[k]);
+        }
+    }, 4);
+    
+    std::vector<uint64> expected, found;
+    
+    fingerprint(a, expected);
+    fingerprint(b, found);
+    
+    check(found == expected, "evaluate_groups scores as evaluate does");
+}
+
+/// A deterministic task: the network's response to fixed inputs.
+static float64 steady(ne_genome* genome) {
+    ne_phenotype& net = *genome->network();
+    
+    net.reset();
+    net.flush();
+    
+    for(uint64 i = 0; i != ne_inputs; ++i) {
+        net.inputs()[i] = 1.0 / (1.0 + i);
+    }
+    
+    net.compute();
+    
+    return fabs(net.outputs()[0]);
+}
+
+/// With a deterministic task the cache changes nothing but the number of
+/// genomes scored.
+static void test_cache() {
+    ne_params p = params;
+    p.population = 64;
+    
+    ne_population a, b, c;
+    a.reset(p, ne_inputs, ne_outputs);
+    
+    p.cache_fitness = 1;
+    b.reset(p, ne_inputs, ne_outputs);
+    c.reset(p, ne_inputs, ne_outputs);
+    
+    std::vector<uint64> expected, found;
+    uint64 hits = 0;
+    
+    for(uint64 n = 0; n != 8; ++n) {
+        std::atomic<uint64> calls(0);
+        std::string name = ", generation " + std::to_string(n);
+        
+        a.evaluate([](ne_genome* genome, uint64) {
+            return steady(genome);
+        });
+        
+        b.evaluate([&calls](ne_genome* genome, uint64) {
+            ++calls;
+            return steady(genome);
+        });
+        
+        check(b.cache_lookups == b.genomes.size() && calls == b.cache_lookups - b.cache_hits, "cache scores exactly the genomes it misses" + name);
+        
+        c.evaluate_groups([](ne_genome* const* genomes, ne_rng*, uint64 count, uint64) {
+            for(uint64 k = 0; k != count; ++k) {
+                genomes[k]->fitness = steady(genomes[k]);
+            }
+        }, 4);
+        
+        hits += b.cache_hits;
+        
+        fingerprint(a, expected);
+        fingerprint(b, found);
+        check(found == expected, "cached evaluate scores as uncached" + name);
+        
+        fingerprint(c, found);
+        check(found == expected, "cached evaluate_groups scores as uncached" + name);
+        
+        for(ne_population* population : { &a, &b, &c }) {
+            population->select();
+            population->reproduce();
+        }
+    }
+    
+    check(hits != 0, "cache answers some genomes");
+}
+
+/// Whether every genome sits in exactly one species, sorted fittest first,
+/// with the fitness sums evolve() keeps.
+static bool speciated(const ne_population& population) {
+    uint64 members = 0;
+    
+    for(const ne_species* sp : population.species) {
+        float64 sum = 0.0;
+        
+        for(uint64 k = 0; k != sp->genomes.size(); ++k) {
+            if(k != 0 && sp->genomes[k]->fitness > sp->genomes[k - 1]->fitness)
+                return false;
+            
+            sum += fmax(0.0, sp->genomes[k]->fitness);
+        }
+        
+        if(sp->genomes.empty() || fabs(sum - sp->fitness_sum) > 1e-9 * (1.0 + sum))
+            return false;
+        
+        members += sp->genomes.size();
+    }
+    
+    return members == population.genomes.size();
+}
+
+/// evolve() scores the whole population once, then exactly the births
+/// asked for, on any thread count, including more threads than genomes.
+static void test_steady() {
+    ne_params p = params;
+    
+    for(uint64 size : { 1, 2, 64 }) {
+        for(uint64 threads : { 1, 4 }) {
+            p.population = size;
+            p.threads = threads;
+            
+            ne_population population;
+            population.reset(p, ne_inputs, ne_outputs);
+            
+            std::atomic<uint64> calls(0);
+            std::string name = ", population " + std::to_string(size) + " on " + std::to_string(threads) + " threads";
+            
+            for(uint64 n = 0; n != 4; ++n) {
+                ne_genome* best = population.evolve(size * 2, [&calls](ne_genome* genome, uint64) {
+                    ++calls;
+                    return noisy(genome);
+                });
+                
+                bool fittest = true;
+                
+                for(const ne_genome* g : population.genomes) {
+                    fittest = fittest && g->fitness <= best->fitness;
+                }
+                
+                check(fittest, "evolve returns the fittest genome" + name);
+            }
+            
+            /// A single genome is the fittest and never makes way.
+            uint64 expected = size == 1 ? 1 : size + 4 * size * 2;
+            
+            check(calls == expected, "evolve scores every birth" + name);
+            check(population.genomes.size() == size, "evolve keeps the population size" + name);
+            check(speciated(population), "evolve keeps the species sorted and summed" + name);
+        }
+    }
+}
+
+/// Crossover children can hold a node an earlier birth of the generation
+/// split off, and split the same gene again; what evolve() saves must
+/// still load.
+static void test_steady_save() {
+    ne_params p = params;
+    p.population = 128;
+    p.new_node_prob = 1.0;
+    p.new_gene_prob = 1.0;
+    p.mutate_only_prob = 0.0;
+    p.mate_only_prob = 0.0;
+    p.interspecies_mate_prob = 0.5;
+    
+    for(uint64 threads : { 1, 4 }) {
+        p.threads = threads;
+        
+        ne_population population, loaded;
+        population.reset(p, ne_inputs, ne_outputs);
+        loaded.reset(p, ne_inputs, ne_outputs);
+        
+        std::string name = " on " + std::to_string(threads) + " threads";
+        
+        bool unique = true;
+        
+        /// Random fitness keeps the parents mixed.
+        for(uint64 n = 0; n != 4; ++n) {
+            population.evolve(p.population, [](ne_genome*, uint64) {
+                return random(0.0, 1.0);
+            });
+            
+            for(ne_genome* genome : population.genomes) {
+                std::vector<uint8> bytes;
+                genome->write(bytes);
+                
+                ne_genome copy;
+                unique = unique && copy.read(bytes.data(), bytes.size()) == bytes.size();
+            }
+        }
+        
+        check(unique, "steady-state genomes read back" + name);
+        
+        std::vector<uint8> bytes, again;
+        population.save(bytes);
+        
+        check(loaded.load(bytes.data(), bytes.size()), "steady-state population loads" + name);
+        
+        loaded.save(again);
+        check(again == bytes, "loaded steady-state population saves the same bytes" + name);
+    }
+}
+
+static void test_checkpoint() {
+    ne_params p = params;
+    p.population = 64;
+    
+    ne_population population, loaded, restored;
+    population.reset(p, ne_inputs, ne_outputs);
+    loaded.reset(p, ne_inputs, ne_outputs);
+    restored.reset(p, ne_inputs, ne_outputs);
+    
+    advance(population, 4);
+    
+    std::vector<uint8> bytes, again;
+    population.save(bytes);
+    
+    check(loaded.load(bytes.data(), bytes.size()), "checkpoint loads");
+    
+    loaded.save(again);
+    check(again == bytes, "loaded checkpoint saves the same bytes");
+    
+    const char* path = "tests.checkpoint";
+    
+    population.checkpoint(path);
+    
+    check(population.sync(), "checkpoint reaches disk");
+    check(restored.restore(path), "checkpoint restores");
+    
+    std::remove(path);
+    
+    again.clear();
+    restored.save(again);
+    check(again == bytes, "restored checkpoint saves the same bytes");
+    
+    check(!loaded.load(bytes.data(), bytes.size() - 1), "truncated checkpoint is refused");
+    check(loaded.load(bytes.data(), bytes.size()), "checkpoint loads after a refusal");
+    
+    std::vector<uint64> expected, found;
+    
+    /// Babies carry no fitness until they are scored.
+    advance(population, 4);
+    advance(loaded, 4);
+    score(population);
+    score(loaded);
+    
+    fingerprint(population, expected);
+    fingerprint(loaded, found);
+    
+    check(found == expected, "loaded population continues bit for bit");
+}
+
+/// Random inputs for `ne_steps` steps, drawn from stream `trial`.
+static void inputs(std::vector<float64>& samples, uint64 trial) {
+    ne_rng rng;
+    rng.seed(params.seed, ne_trials + trial);
+    ne_stream_scope scope(&rng);
+    
+    samples.resize(ne_steps * ne_inputs);
+    
+    for(float64& x : samples) {
+        x = random(-2.0, 2.0);
+    }
+}
+
+static bool same(const ne_quantization_report& a, const ne_quantization_report& b) {
+    return a.outputs == b.outputs && same(a.max_error, b.max_error) && same(a.mean_error, b.mean_error);
+}
+
+template <class W>
+static void round_trip(const ne_basic_quantized<W>& q, const ne_genome& genome, const std::vector<float64>& samples, const std::string& name) {
+    std::vector<uint8> bytes, again;
+    q.write(bytes);
+    
+    ne_basic_quantized<W> loaded;
+    
+    bool read = loaded.read(bytes.data(), bytes.size()) == bytes.size();
+    check(read, "quantized network reads back" + name);
+    
+    if(!read) return;
+    
+    loaded.write(again);
+    
+    check(again == bytes, "quantized network writes back the same bytes" + name);
+    check(same(loaded.report(&genome, samples.data(), ne_steps), q.report(&genome, samples.data(), ne_steps)), "loaded quantized network computes the same" + name);
+    check(loaded.read(bytes.data(), bytes.size() - 1) == 0, "truncated quantized network is refused" + name);
+}
+
+static void test_quantize() {
+    for(uint64 trial = 0; trial != ne_trials; ++trial) {
+        ne_genome genome;
+        make(&genome, 4 + trial * 2, 1 + trial % 4, trial);
+        
+        std::vector<float64> samples;
+        inputs(samples, trial);
+        
+        bool forward = trial % 2 != 0 && genome.acyclic();
+        
+        ne_quantized8 q8(&genome, samples.data(), ne_steps, forward);
+        ne_quantized16 q16(&genome, samples.data(), ne_steps, forward);
+        
+        ne_quantization_report r8 = q8.report(&genome, samples.data(), ne_steps);
+        ne_quantization_report r16 = q16.report(&genome, samples.data(), ne_steps);
+        
+        std::string name = ", trial " + std::to_string(trial);
+        
+        /// Networks with large values amplify rounding through their
+        /// recurrent steps, and past the int16 range they saturate, so
+        /// only the binary form of those is checked.
+        if(q16.value_bits() >= 8) {
+            float64 range = ldexp(1.0, 15 - (int) q16.value_bits());
+            
+            check(r16.max_error <= range / 128.0, "int16 error is within 1/128 of the value range" + name);
+            check(r16.max_error <= r8.max_error, "int16 is no worse than int8" + name);
+        }
+        
+        round_trip(q8, genome, samples, name);
+        round_trip(q16, genome, samples, name);
+        
+        std::vector<uint8> bytes;
+        q16.write(bytes);
+        
+        check(ne_quantized8().read(bytes.data(), bytes.size()) == 0, "int16 network is refused as int8" + name);
+    }
+}
+
+/// Writes the generated code of every trial genome to codegen_check.cpp
+/// with a main that steps each one through the inputs of agree() and
+/// compares its outputs, bit for bit, with those of ne_phenotype64. `make
+/// test` builds and runs it with the flags of this library.
+static void test_codegen() {
+    std::ofstream out("codegen_check.cpp");
+    out << std::setprecision(17);
+    
+    out << "// Generated by tests. Exits nonzero if a generated network differs from its genome." << std::endl;
+    out << std::endl;
+    out << "#include <cstdio>" << std::endl;
+    out << "#include <cstring>" << std::endl;
+    out << std::endl;
+    out << "template <class S, class R, class F, class C>" << std::endl;
+    out << "static int check(const char* name, R reset, F flush, C compute, const double* inputs, const unsigned long long* outputs) {" << std::endl;
+    out << "    S state;" << std::endl;
+    out << "    reset(&state);" << std::endl;
+    out << "    flush(&state);" << std::endl;
+    out << "    " << std::endl;
+    out << "    double y[" << ne_outputs << "];" << std::endl;
+    out << "    int failures = 0;" << std::endl;
+    out << "    " << std::endl;
+    out << "    for(unsigned k = 0; k != " << ne_steps << "; ++k) {" << std::endl;
+    out << "        compute(&state, inputs + k * " << ne_inputs << ", y);" << std::endl;
+    out << "        " << std::endl;
+    out << "        for(unsigned o = 0; o != " << ne_outputs << "; ++o) {" << std::endl;
+    out << "            unsigned long long bits;" << std::endl;
+    out << "            std::memcpy(&bits, &y[o], sizeof(bits));" << std::endl;
+    out << "            " << std::endl;
+    out << "            if(bits != outputs[k * " << ne_outputs << " + o]) {" << std::endl;
+    out << "                std::printf(\"FAIL %s step %u output %u\\n\", name, k, o);" << std::endl;
+    out << "                ++failures;" << std::endl;
+    out << "            }" << std::endl;
+    out << "        }" << std::endl;
+    out << "    }" << std::endl;
+    out << "    " << std::endl;
+    out << "    return failures;" << std::endl;
+    out << "}" << std::endl;
+    out << std::endl;
+    
+    std::ostringstream runs;
+    uint64 generated = 0;
+    
+    for(uint64 trial = 0; trial != ne_trials; ++trial) {
+        ne_genome genome;
+        make(&genome, 8 + trial * 8, 1 + trial % 4, trial);
+        
+        bool forward = trial % 2 != 0 && genome.acyclic();
+        
+        ne_codegen codegen(&genome, forward);
+        
+        if(!codegen.valid()) continue;
+        
+        std::string name = "net" + std::to_string(trial);
+        
+        codegen.write(out, name);
+        out << std::endl;
+        
+        ne_phenotype64 net(&genome, forward);
+        net.reset();
+        net.flush();
+        
+        ne_rng rng;
+        rng.seed(params.seed, ne_trials + trial);
+        ne_stream_scope scope(&rng);
+        
+        std::ostringstream xs, ys;
+        xs << std::setprecision(17);
+        
+        for(uint64 step = 0; step != ne_steps; ++step) {
+            for(uint64 i = 0; i != ne_inputs; ++i) {
+                float64 x = random(-2.0, 2.0);
+                
+                net.inputs()[i] = x;
+                xs << " " << x << ",";
+            }
+            
+            net.compute();
+            
+            for(uint64 o = 0; o != ne_outputs; ++o) {
+                ys << " " << ne_bits(net.outputs()[o]) << "ull,";
+            }
+        }
+        
+        runs << "    {" << std::endl;
+        runs << "        static const double inputs[] = {" << xs.str() << " };" << std::endl;
+        runs << "        static const unsigned long long outputs[] = {" << ys.str() << " };" << std::endl;
+        runs << "        differ += check<" << name << "_state>(\"" << name << "\", " << name << "_reset, " << name << "_flush, " << name << "_compute, inputs, outputs) != 0;" << std::endl;
+        runs << "    }" << std::endl;
+        runs << "    " << std::endl;
+        
+        ++generated;
+    }
+    
+    out << "int main() {" << std::endl;
+    out << "    int differ = 0;" << std::endl;
+    out << "    " << std::endl;
+    out << runs.str();
+    out << "    std::printf(\"%d of " << generated << " generated networks differ\\n\", differ);" << std::endl;
+    out << "    " << std::endl;
+    out << "    return differ == 0 ? 0 : 1;" << std::endl;
+    out << "}" << std::endl;
+    
+    check(out.good(), "codegen_check.cpp is written");
+    check(generated != 0, "some genomes can be generated");
+}
+
+static const ne_case cases[] = {
+    { "phenotype", test_phenotype },
+    { "feed_forward", test_feed_forward },
+    { "threads", test_threads },
+    { "genome/io", test_genome_io },
+    { "incremental", test_incremental },
+    { "group", test_group },
+    { "evaluate_groups", test_evaluate_groups },
+    { "cache", test_cache },
+    { "steady", test_steady },
+    { "steady/save", test_steady_save },
+    { "checkpoint", test_checkpoint },
+    { "quantize", test_quantize },
+    { "codegen", test_codegen },
+};
+
+int main(int argc, const char * argv[]) {
+    if(argc == 1) {
+        std::cout << "Usage: tests <params file> [filter]" << std::endl;
+        return 1;
+    }
+    
+    std::ifstream in(argv[1]);
+    
+    if(!params.load(in)) {
+        std::cout << "Cannot read " << argv[1] << std::endl;
+        return 1;
+    }
+    
+    if(argc > 2)
+        filter = argv[2];
+    
+    if(params.seed == 0)
+        params.seed = 1;
+    
+    ne_seed(params.seed);
+    
+    for(const ne_case& c : cases) {
+        if(!filter.empty() && strstr(c.name, filter.c_str()) == nullptr)
+            continue;
+        
+        uint64 before = failures;
+        
+        c.run();
+        
+        std::cout << (failures == before ? "ok   " : "FAIL ") << c.name << std::endl;
+    }
+    
+    std::cout << checks - failures << " / " << checks << " checks passed" << std::endl;
+    
+    return failures == 0 ? 0 : 1;
+}
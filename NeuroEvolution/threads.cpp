@@ -0,0 +1,152 @@
+//
+//  threads.cpp
+//  NeuroEvolution
+//
+
+#include "threads.h"
+
+static std::atomic<uint64> ne_running_threads(0);
+
+uint64 ne_thread_pool::running() {
+    return ne_running_threads;
+}
+
+void ne_thread_pool::reset(uint64 count) {
+    _join();
+    
+    if(count == 0)
+        count = std::max(1u, std::thread::hardware_concurrency());
+    
+    quit = false;
+    generation = 0;
+    busy = 0;
+    
+    std::vector<ne_queue>(count).swap(queues);
+    
+    for(uint64 i = 1; i < count; ++i) {
+        threads.emplace_back(&ne_thread_pool::_loop, this, i);
+    }
+    
+    ne_running_threads += threads.size();
+}
+
+void ne_thread_pool::run(uint64 n, const ne_task& fn) {
+    uint64 size = queues.size();
+    
+    if(size == 1 || n <= 1) {
+        for(uint64 i = 0; i != n; ++i) {
+            fn(i, 0);
+        }
+        
+        return;
+    }
+    
+    for(uint64 k = 0; k != size; ++k) {
+        std::lock_guard<std::mutex> lock(queues[k].mutex);
+        queues[k].begin = (n * k) / size;
+        queues[k].end = (n * (k + 1)) / size;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &fn;
+        busy = size - 1;
+        ++generation;
+    }
+    
+    wake.notify_all();
+    
+    _work(0);
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    task = nullptr;
+}
+
+bool ne_thread_pool::_pop(uint64 worker, uint64* i) {
+    ne_queue& q = queues[worker];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    
+    if(q.begin == q.end)
+        return false;
+    
+    *i = q.begin++;
+    return true;
+}
+
+bool ne_thread_pool::_steal(uint64 worker) {
+    uint64 size = queues.size();
+    
+    for(uint64 k = 1; k != size; ++k) {
+        ne_queue& victim = queues[(worker + k) % size];
+        uint64 begin, end;
+        
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            
+            if(victim.begin == victim.end)
+                continue;
+            
+            end = victim.end;
+            begin = end - (end - victim.begin + 1) / 2;
+            victim.end = begin;
+        }
+        
+        ne_queue& q = queues[worker];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.begin = begin;
+        q.end = end;
+        return true;
+    }
+    
+    return false;
+}
+
+void ne_thread_pool::_work(uint64 worker) {
+    const ne_task& fn = *task;
+    uint64 i;
+    
+    do {
+        while(_pop(worker, &i)) {
+            fn(i, worker);
+        }
+    } while(_steal(worker));
+}
+
+void ne_thread_pool::_loop(uint64 worker) {
+    uint64 seen = 0;
+    
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, seen] { return quit || generation != seen; });
+            
+            if(quit) return;
+            
+            seen = generation;
+        }
+        
+        _work(worker);
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        if(--busy == 0)
+            done.notify_one();
+    }
+}
+
+void ne_thread_pool::_join() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    
+    wake.notify_all();
+    
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+    
+    ne_running_threads -= threads.size();
+    threads.clear();
+}
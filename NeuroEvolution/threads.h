@@ -0,0 +1,80 @@
+//
+//  threads.h
+//  NeuroEvolution
+//
+
+#ifndef ne_threads_h
+#define ne_threads_h
+
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void (uint64 i, uint64 worker)> ne_task;
+
+/// A fixed set of workers that run index ranges. Every worker starts with
+/// a contiguous share of the range and steals half of another worker's
+/// remaining share once its own runs dry, so uneven task costs still keep
+/// all of them busy. The calling thread takes part as worker 0.
+class ne_thread_pool
+{
+    
+public:
+    
+    ne_thread_pool() : queues(1) {}
+    
+    ne_thread_pool(const ne_thread_pool& pool) = delete;
+    
+    ne_thread_pool& operator = (const ne_thread_pool& pool) = delete;
+    
+    ~ne_thread_pool() {
+        _join();
+    }
+    
+    inline uint64 size() const {
+        return queues.size();
+    }
+    
+    void reset(uint64 threads);
+    
+    /// The workers of every pool in this process that are alive.
+    static uint64 running();
+    
+    void run(uint64 n, const ne_task& task);
+    
+private:
+    
+    struct ne_queue
+    {
+        std::mutex mutex;
+        
+        uint64 begin;
+        uint64 end;
+    };
+    
+    bool _pop(uint64 worker, uint64* i);
+    bool _steal(uint64 worker);
+    
+    void _work(uint64 worker);
+    void _loop(uint64 worker);
+    void _join();
+    
+    std::vector<std::thread> threads;
+    std::vector<ne_queue> queues;
+    
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    
+    const ne_task* task = nullptr;
+    
+    uint64 generation = 0;
+    uint64 busy = 0;
+    
+    bool quit = false;
+};
+
+#endif /* ne_threads_h */